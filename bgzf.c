@@ -0,0 +1,51 @@
+#include "bgzf.h"
+#include "decompress.h"
+#include "log.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <string.h>
+
+// header, empty deflate block and trailer
+// ref: https://samtools.github.io/hts-specs/SAMv1.pdf section 4.1.2
+static const uint8_t bgzf_eof_block[BGZF_EOF_BLOCK_SIZE] = {
+    0x1f, 0x8b, 0x08, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff,
+    0x06, 0x00, 0x42, 0x43, 0x02, 0x00, 0x1b, 0x00, 0x03, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+};
+
+bool bgzf_block_size(uint8_t *buf, size_t buf_len, size_t pos,
+                     size_t *block_size)
+{
+    // not being a BGZF block isn't an error
+    bool quiet = quiet_errors;
+    quiet_errors = true;
+    size_t data_pos = pos;
+    struct member_header header;
+    bool success = check_member_header(buf, buf_len, &data_pos, &header);
+    quiet_errors = quiet;
+    if (!success)
+        return false;
+
+    uint8_t *BC;
+    uint16_t SLEN;
+    if (!find_extra_subfield(&header, 'B', 'C', &BC, &SLEN) || SLEN != 2)
+        return false;
+
+    // BSIZE is the total block size minus 1, it has to leave room for
+    // the 8 byte trailer
+    size_t size = (size_t) (BC[0] + 256 * BC[1]) + 1;
+    if (size > buf_len - pos || size < data_pos - pos + 8)
+        return false;
+
+    *block_size = size;
+    return true;
+}
+
+bool is_bgzf_eof_block(uint8_t *buf, size_t buf_len, size_t pos)
+{
+    if (buf_len - pos < BGZF_EOF_BLOCK_SIZE)
+        return false;
+
+    return memcmp(buf + pos, bgzf_eof_block, BGZF_EOF_BLOCK_SIZE) == 0;
+}
@@ -0,0 +1,22 @@
+#ifndef BGZF
+#define BGZF
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// BGZF files are made of members of at most 64KiB each, every member
+// stores its own total size in the BC subfield of FEXTRA, so the member
+// boundaries are known without decompressing
+// ref: https://samtools.github.io/hts-specs/SAMv1.pdf section 4.1
+
+#define BGZF_EOF_BLOCK_SIZE 28
+
+// return false if the member at pos isn't a BGZF block
+bool bgzf_block_size(uint8_t *buf, size_t buf_len, size_t pos,
+                     size_t *block_size);
+
+// the empty block BGZF writers append to mark the end of the file
+bool is_bgzf_eof_block(uint8_t *buf, size_t buf_len, size_t pos);
+
+#endif
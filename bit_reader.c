@@ -0,0 +1,92 @@
+#include "bit_reader.h"
+
+#include <inttypes.h>
+#include <stddef.h>
+
+void bit_reader_init(struct bit_reader *br, const uint8_t *buf,
+                     size_t buf_len, size_t buf_pos)
+{
+    br->buf = buf;
+    br->buf_len = buf_len;
+    br->buf_pos = buf_pos;
+    br->bits = 0;
+    br->bit_cnt = 0;
+    br->overrun = 0;
+    br->fill = NULL;
+    br->fill_arg = NULL;
+    return;
+}
+
+// reading starts in the middle of the byte at bit_pos / 8
+void bit_reader_init_at_bit(struct bit_reader *br, const uint8_t *buf,
+                            size_t buf_len, uint64_t bit_pos)
+{
+    bit_reader_init(br, buf, buf_len, (size_t) (bit_pos / 8));
+    refill_bits(br);
+    consume_bits(br, bit_pos % 8);
+    return;
+}
+
+void bit_reader_set_fill(struct bit_reader *br, bit_reader_fill fill,
+                         void *fill_arg)
+{
+    br->fill = fill;
+    br->fill_arg = fill_arg;
+    return;
+}
+
+// drops the loaded bits, reading continues at byte buf_pos
+void bit_reader_seek(struct bit_reader *br, size_t buf_pos)
+{
+    br->buf_pos = buf_pos;
+    br->bits = 0;
+    br->bit_cnt = 0;
+    br->overrun = 0;
+    return;
+}
+
+// makes n bytes from byte *pos of the input buffer available by reading
+// more input, *pos is moved along with the bytes
+bool bit_reader_ensure_bytes(struct bit_reader *br, size_t *pos, size_t n)
+{
+    while (br->buf_len - *pos < n) {
+        if (br->fill == NULL)
+            return false;
+
+        // bytes which are loaded but not consumed stay in the buffer, the
+        // ones before keep are dropped even if there is no more input
+        size_t keep = br->buf_pos > 8 ? br->buf_pos - 8 : 0;
+        if (keep > *pos)
+            keep = *pos;
+        bool more = br->fill(br->fill_arg, keep, &br->buf, &br->buf_len);
+        br->buf_pos -= keep;
+        *pos -= keep;
+        if (!more)
+            return false;
+    }
+
+    return true;
+}
+
+// near the end of input buffer bytes are loaded one at a time and
+// zero bytes are loaded past its end, bit_reader_overrun tells if
+// any of them was consumed
+void refill_bits_slow(struct bit_reader *br)
+{
+    size_t pos = br->buf_pos;
+    if (br->fill != NULL && bit_reader_ensure_bytes(br, &pos, 8)) {
+        refill_bits_fast(br);
+        return;
+    }
+
+    while (br->bit_cnt < BIT_READER_MIN_BITS) {
+        if (br->buf_pos < br->buf_len) {
+            br->bits |= (uint64_t) br->buf[br->buf_pos++] << br->bit_cnt;
+        } else {
+            br->overrun++;
+        }
+        br->bit_cnt += 8;
+    }
+
+    return;
+}
@@ -0,0 +1,117 @@
+#ifndef BIT_READER
+#define BIT_READER
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+// input which is read a piece at a time comes with a fill function that
+// replaces the buffer with one starting with the bytes from keep on and
+// followed by more input, it returns false if there is no more input
+typedef bool (*bit_reader_fill)(void *arg, size_t keep, const uint8_t **buf,
+                                size_t *buf_len);
+
+// bits of the input are kept in a 64 bit buffer in order from lsb to
+// msb, a refill tops it up to at least 56 bits so that a huffman code
+// and its extra bits can be read without checking the input length
+// ref: https://www.rfc-editor.org/rfc/rfc1951.txt section 3.1.1
+
+struct bit_reader {
+    const uint8_t *buf; // input buffer
+    size_t buf_len;     // input buffer length
+    size_t buf_pos;     // next byte of input buffer to load into bits
+    uint64_t bits;      // loaded bits which haven't been consumed yet
+    uint8_t bit_cnt;    // number of valid bits in bits
+    size_t overrun;     // zero bytes loaded past the end of input buffer
+    bit_reader_fill fill; // NULL if buf holds all of the input
+    void *fill_arg;
+};
+
+#define BIT_READER_MIN_BITS 56
+
+void bit_reader_init(struct bit_reader *br, const uint8_t *buf,
+                     size_t buf_len, size_t buf_pos);
+void bit_reader_init_at_bit(struct bit_reader *br, const uint8_t *buf,
+                            size_t buf_len, uint64_t bit_pos);
+void bit_reader_set_fill(struct bit_reader *br, bit_reader_fill fill,
+                         void *fill_arg);
+void bit_reader_seek(struct bit_reader *br, size_t buf_pos);
+bool bit_reader_ensure_bytes(struct bit_reader *br, size_t *pos, size_t n);
+void refill_bits_slow(struct bit_reader *br);
+
+static inline uint64_t load_le64(const uint8_t *p)
+{
+    uint64_t word;
+    memcpy(&word, p, sizeof(word));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    word = __builtin_bswap64(word);
+#endif
+    return word;
+}
+
+// at least 8 bytes need to be left in the input buffer
+static inline void refill_bits_fast(struct bit_reader *br)
+{
+    // bits above bit_cnt are the bytes that the next refill loads
+    // again, so or-ing them in a second time doesn't change them
+    br->bits |= load_le64(br->buf + br->buf_pos) << br->bit_cnt;
+    br->buf_pos += (63 - br->bit_cnt) >> 3;
+    br->bit_cnt |= 56;
+}
+
+// after a refill at least BIT_READER_MIN_BITS bits can be consumed
+static inline void refill_bits(struct bit_reader *br)
+{
+    if (br->buf_len - br->buf_pos >= 8) {
+        refill_bits_fast(br);
+        return;
+    }
+
+    refill_bits_slow(br);
+}
+
+static inline uint64_t peek_bits(struct bit_reader *br)
+{
+    return br->bits;
+}
+
+static inline void consume_bits(struct bit_reader *br, uint8_t bits)
+{
+    br->bits >>= bits;
+    br->bit_cnt -= bits;
+}
+
+// read and consume bits which are already loaded in the bit buffer
+static inline uint32_t take_bits(struct bit_reader *br, uint8_t bits)
+{
+    uint32_t value = (uint32_t) (br->bits & ((1ull << bits) - 1));
+    consume_bits(br, bits);
+    return value;
+}
+
+// true if bits past the end of input buffer have been consumed
+static inline bool bit_reader_overrun(struct bit_reader *br)
+{
+    return br->overrun * 8 > br->bit_cnt;
+}
+
+// input bits are aligned to the next byte boundary
+static inline void align_to_byte(struct bit_reader *br)
+{
+    consume_bits(br, br->bit_cnt & 7);
+}
+
+// position in input buffer of the next byte, only valid at a byte boundary
+static inline size_t bit_reader_byte_position(struct bit_reader *br)
+{
+    return br->buf_pos + br->overrun - br->bit_cnt / 8;
+}
+
+// position in input buffer of the next bit counted in bits
+static inline uint64_t bit_reader_bit_position(struct bit_reader *br)
+{
+    return (uint64_t) (br->buf_pos + br->overrun) * 8 - br->bit_cnt;
+}
+
+#endif
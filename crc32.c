@@ -0,0 +1,174 @@
+#include "crc32.h"
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define CRC32_PCLMUL
+#endif
+
+// reflected polynomial x^32+x^26+x^23+x^22+x^16+x^12+x^11+x^10+x^8+x^7+x^5+x^4+x^2+x+1
+#define CRC32_POLY 0xedb88320u
+
+// crc_table[0] is the byte at a time table, crc_table[k] advances the
+// crc of a byte by k more zero bytes so 16 bytes are folded at once
+static uint32_t crc_table[16][256];
+
+static inline uint32_t load_le32(const uint8_t *p)
+{
+    uint32_t word;
+    memcpy(&word, p, sizeof(word));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    word = __builtin_bswap32(word);
+#endif
+    return word;
+}
+
+// crc is the inverted value kept while processing the bytes
+static uint32_t crc32_slice16(uint32_t crc, const uint8_t *buf, size_t len)
+{
+    while (len >= 16) {
+        uint32_t a = crc ^ load_le32(buf);
+        uint32_t b = load_le32(buf + 4);
+        uint32_t c = load_le32(buf + 8);
+        uint32_t d = load_le32(buf + 12);
+
+        crc = crc_table[15][a & 0xff] ^ crc_table[14][(a >> 8) & 0xff] ^
+            crc_table[13][(a >> 16) & 0xff] ^ crc_table[12][a >> 24] ^
+            crc_table[11][b & 0xff] ^ crc_table[10][(b >> 8) & 0xff] ^
+            crc_table[9][(b >> 16) & 0xff] ^ crc_table[8][b >> 24] ^
+            crc_table[7][c & 0xff] ^ crc_table[6][(c >> 8) & 0xff] ^
+            crc_table[5][(c >> 16) & 0xff] ^ crc_table[4][c >> 24] ^
+            crc_table[3][d & 0xff] ^ crc_table[2][(d >> 8) & 0xff] ^
+            crc_table[1][(d >> 16) & 0xff] ^ crc_table[0][d >> 24];
+
+        buf += 16;
+        len -= 16;
+    }
+
+    while (len--)
+        crc = crc_table[0][(crc ^ *buf++) & 0xff] ^ (crc >> 8);
+
+    return crc;
+}
+
+static uint32_t (*crc32_bulk)(uint32_t crc, const uint8_t *buf,
+                              size_t len) = crc32_slice16;
+
+#ifdef CRC32_PCLMUL
+
+// folding constants x^k mod P for the reflected polynomial
+// ref: Intel "Fast CRC Computation for Generic Polynomials Using
+// PCLMULQDQ Instruction"
+static const uint64_t fold_4x128[2] __attribute__((aligned(16))) =
+    {0x0154442bd4, 0x01c6e41596};
+static const uint64_t fold_1x128[2] __attribute__((aligned(16))) =
+    {0x01751997d0, 0x00ccaa009e};
+static const uint64_t fold_64[2] __attribute__((aligned(16))) =
+    {0x0163cd6124, 0x0000000000};
+static const uint64_t barrett[2] __attribute__((aligned(16))) =
+    {0x01db710641, 0x01f7011641};
+
+__attribute__((target("pclmul,sse4.1")))
+static inline __m128i fold_128(__m128i x, __m128i k, __m128i next)
+{
+    __m128i lo = _mm_clmulepi64_si128(x, k, 0x00);
+    __m128i hi = _mm_clmulepi64_si128(x, k, 0x11);
+    return _mm_xor_si128(_mm_xor_si128(lo, hi), next);
+}
+
+// folds 64 bytes at a time in four lanes with carry-less multiplies
+// and reduces the result with barrett reduction
+__attribute__((target("pclmul,sse4.1")))
+static uint32_t crc32_pclmul(uint32_t crc, const uint8_t *buf, size_t len)
+{
+    if (len < 64)
+        return crc32_slice16(crc, buf, len);
+
+    size_t tail = len & 15;
+    len -= tail;
+
+    __m128i x1 = _mm_loadu_si128((const __m128i *) (buf + 0x00));
+    __m128i x2 = _mm_loadu_si128((const __m128i *) (buf + 0x10));
+    __m128i x3 = _mm_loadu_si128((const __m128i *) (buf + 0x20));
+    __m128i x4 = _mm_loadu_si128((const __m128i *) (buf + 0x30));
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int) crc));
+    buf += 64;
+    len -= 64;
+
+    __m128i k = _mm_load_si128((const __m128i *) fold_4x128);
+    while (len >= 64) {
+        x1 = fold_128(x1, k, _mm_loadu_si128((const __m128i *) (buf + 0x00)));
+        x2 = fold_128(x2, k, _mm_loadu_si128((const __m128i *) (buf + 0x10)));
+        x3 = fold_128(x3, k, _mm_loadu_si128((const __m128i *) (buf + 0x20)));
+        x4 = fold_128(x4, k, _mm_loadu_si128((const __m128i *) (buf + 0x30)));
+        buf += 64;
+        len -= 64;
+    }
+
+    k = _mm_load_si128((const __m128i *) fold_1x128);
+    x1 = fold_128(x1, k, x2);
+    x1 = fold_128(x1, k, x3);
+    x1 = fold_128(x1, k, x4);
+
+    while (len >= 16) {
+        x1 = fold_128(x1, k, _mm_loadu_si128((const __m128i *) buf));
+        buf += 16;
+        len -= 16;
+    }
+
+    // fold 128 bits to 64 bits
+    __m128i mask = _mm_setr_epi32(~0, 0, ~0, 0);
+    __m128i t = _mm_clmulepi64_si128(x1, k, 0x10);
+    x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), t);
+    k = _mm_loadl_epi64((const __m128i *) fold_64);
+    t = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, mask);
+    x1 = _mm_clmulepi64_si128(x1, k, 0x00);
+    x1 = _mm_xor_si128(x1, t);
+
+    // barrett reduction to 32 bits
+    k = _mm_load_si128((const __m128i *) barrett);
+    t = _mm_and_si128(x1, mask);
+    t = _mm_clmulepi64_si128(t, k, 0x10);
+    t = _mm_and_si128(t, mask);
+    t = _mm_clmulepi64_si128(t, k, 0x00);
+    x1 = _mm_xor_si128(x1, t);
+
+    crc = (uint32_t) _mm_extract_epi32(x1, 1);
+    return crc32_slice16(crc, buf, tail);
+}
+
+#endif
+
+__attribute__((constructor))
+static void init_crc32(void)
+{
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t crc = i;
+        for (uint8_t bit = 0; bit < 8; ++bit)
+            crc = crc & 1 ? (crc >> 1) ^ CRC32_POLY : crc >> 1;
+        crc_table[0][i] = crc;
+    }
+
+    for (uint32_t i = 0; i < 256; ++i) {
+        for (uint8_t k = 1; k < 16; ++k) {
+            uint32_t prev = crc_table[k - 1][i];
+            crc_table[k][i] = (prev >> 8) ^ crc_table[0][prev & 0xff];
+        }
+    }
+
+#ifdef CRC32_PCLMUL
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1"))
+        crc32_bulk = crc32_pclmul;
+#endif
+    return;
+}
+
+uint32_t crc32_update(uint32_t crc, const uint8_t *buf, size_t len)
+{
+    return ~crc32_bulk(~crc, buf, len);
+}
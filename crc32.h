@@ -0,0 +1,11 @@
+#ifndef CRC32
+#define CRC32
+
+#include <inttypes.h>
+#include <stddef.h>
+
+// update crc with len bytes of buf, start with crc 0
+// ref: https://www.rfc-editor.org/rfc/rfc1952.txt section 8
+uint32_t crc32_update(uint32_t crc, const uint8_t *buf, size_t len);
+
+#endif
@@ -0,0 +1,102 @@
+#include "crc_worker.h"
+#include "crc32.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <pthread.h>
+
+static void *crc_worker_run(void *arg)
+{
+    struct crc_worker *worker = arg;
+
+    pthread_mutex_lock(&worker->lock);
+    while (true) {
+        while (worker->buf == NULL && !worker->stop)
+            pthread_cond_wait(&worker->cond, &worker->lock);
+        if (worker->buf == NULL)
+            break;
+
+        const uint8_t *buf = worker->buf;
+        size_t len = worker->len;
+        uint32_t crc = worker->crc;
+        pthread_mutex_unlock(&worker->lock);
+
+        crc = crc32_update(crc, buf, len);
+
+        pthread_mutex_lock(&worker->lock);
+        worker->crc = crc;
+        worker->buf = NULL;
+        pthread_cond_broadcast(&worker->cond);
+    }
+    pthread_mutex_unlock(&worker->lock);
+
+    return NULL;
+}
+
+bool crc_worker_start(struct crc_worker *worker)
+{
+    worker->buf = NULL;
+    worker->len = 0;
+    worker->crc = 0;
+    worker->stop = false;
+
+    if (pthread_mutex_init(&worker->lock, NULL) != 0)
+        return false;
+
+    if (pthread_cond_init(&worker->cond, NULL) != 0) {
+        pthread_mutex_destroy(&worker->lock);
+        return false;
+    }
+
+    if (pthread_create(&worker->thread, NULL, crc_worker_run, worker) != 0) {
+        fprintf(stderr, "Failed to create CRC32 thread\n");
+        pthread_cond_destroy(&worker->cond);
+        pthread_mutex_destroy(&worker->lock);
+        return false;
+    }
+
+    return true;
+}
+
+// waits for the previous chunk to be processed before handing over buf
+void crc_worker_submit(struct crc_worker *worker, const uint8_t *buf,
+                       size_t len)
+{
+    pthread_mutex_lock(&worker->lock);
+    while (worker->buf != NULL)
+        pthread_cond_wait(&worker->cond, &worker->lock);
+    if (len) {
+        worker->buf = buf;
+        worker->len = len;
+        pthread_cond_broadcast(&worker->cond);
+    }
+    pthread_mutex_unlock(&worker->lock);
+    return;
+}
+
+// waits for all submitted chunks and returns their CRC32
+uint32_t crc_worker_wait(struct crc_worker *worker)
+{
+    pthread_mutex_lock(&worker->lock);
+    while (worker->buf != NULL)
+        pthread_cond_wait(&worker->cond, &worker->lock);
+    uint32_t crc = worker->crc;
+    pthread_mutex_unlock(&worker->lock);
+
+    return crc;
+}
+
+void crc_worker_stop(struct crc_worker *worker)
+{
+    pthread_mutex_lock(&worker->lock);
+    worker->stop = true;
+    pthread_cond_broadcast(&worker->cond);
+    pthread_mutex_unlock(&worker->lock);
+
+    // a chunk still being processed is finished first
+    pthread_join(worker->thread, NULL);
+    pthread_cond_destroy(&worker->cond);
+    pthread_mutex_destroy(&worker->lock);
+    return;
+}
@@ -0,0 +1,28 @@
+#ifndef CRC_WORKER
+#define CRC_WORKER
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
+
+// computes CRC32 of output chunks on a separate thread while the next
+// chunk is being decompressed, a chunk must stay untouched until the
+// next call to crc_worker_submit or crc_worker_wait returns
+struct crc_worker {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    const uint8_t *buf; // chunk being processed, NULL if idle
+    size_t len;         // length of chunk being processed
+    uint32_t crc;       // CRC32 of all processed chunks
+    bool stop;          // set to make the thread exit
+};
+
+bool crc_worker_start(struct crc_worker *worker);
+void crc_worker_submit(struct crc_worker *worker, const uint8_t *buf,
+                       size_t len);
+uint32_t crc_worker_wait(struct crc_worker *worker);
+void crc_worker_stop(struct crc_worker *worker);
+
+#endif
@@ -1,84 +1,86 @@
 #include "decompress.h"
-#include "huffman_tree.h"
+#include "deflate.h"
+#include "huffman_table.h"
+#include "bit_reader.h"
+#include "match_copy.h"
+#include "crc32.h"
+#include "crc_worker.h"
+#include "parallel.h"
+#include "index.h"
+#include "speculative.h"
+#include "input.h"
+#include "log.h"
 
 #include <stdio.h>
+#include <string.h>
 #include <inttypes.h>
 #include <stdbool.h>
+#include <malloc.h>
+#include <time.h>
 
-#define MAX_DISTANCE 32768
-#define OUT_BUF_SIZE 8192
+// the fast decoding loop runs while the input has a full word left for
+// refilling the bit buffer and the output buffer has space for the
+// longest match and what match copies write past it
+#define FAST_INPUT_MARGIN 8
+#define FAST_OUTPUT_MARGIN (258 + MATCH_COPY_SLACK)
 
-struct value_and_bits {
-    uint16_t value;       // value of the length or distance code
-    uint8_t extra_bits;   // extra bits to read after the code
-};
+// a 258 byte match takes at least 2 bits in a deflate stream, so a
+// member can't be larger than this times its compressed size
+#define MAX_DEFLATE_RATIO 1032
+
+// the output the first dynamic block of a member is taken to have, later
+// ones are taken to be about as large as the one before
+#define FIRST_BLOCK_SIZE 65536
 
 struct decompression_data {
-    uint8_t *buf;           // input buffer of compressed file
-    size_t buf_len;         // input buffer length
-    size_t buf_pos;         // next position in input buffer we need to read
-    uint8_t byte_pos;       // next bit position in current byte of input buffer
-    uint8_t *back_refs;     // last 32768 decompressed bytes (cyclic)
-    uint16_t back_refs_pos; // next position in back refs we will put the next decompressed byte
-    bool back_refs_filled;  // if back refs has been fully filled at least once
-    uint8_t *out_buf;       // output buffer
-    uint32_t out_pos;       // next position in output buffer
-    FILE *f;                // output file stream
+    struct bit_reader in;   // bits of input buffer of compressed file
+    uint8_t *out_buf;       // output buffer of out_buf_size bytes
+    size_t out_buf_size;
+    size_t write_size;      // output written at a time
+    bool in_place;          // out_buf is in the room of the sink
+    size_t out_pos;         // next position in output buffer
+    size_t write_pos;       // start of output not written to file yet
+    uint32_t crc;           // CRC32 of output written so far
+    uint64_t size;          // size of output written so far
+    struct sink *sink;      // output is written to sink
+    uint64_t out_skip;      // output before this isn't written to sink
+    uint64_t out_limit;     // decoding stops at the first block boundary here
+    struct gzip_index *index; // checkpoints are added to index if not NULL
+    bool crc_thread;        // compute CRC32 on crc_worker once output is flushed
+    bool crc_worker_started;
+    struct crc_worker crc_worker;
+    uint8_t *spare_buf;     // output buffer decoded into while crc_worker reads out_buf
+    uint64_t last_block_size; // output of the last dynamic block
+    struct table_stats *stats; // dynamic blocks are timed if not NULL
 };
 
-// {length, extra_bits} for length codes 257 to 285
-// ref: https://www.ietf.org/rfc/rfc1951.txt section 3.2.5
-static struct value_and_bits length_data[] = {{3, 0}, {4, 0}, {5, 0}, {6, 0},
-                                              {7, 0}, {8, 0}, {9, 0}, {10, 0},
-                                              {11, 1}, {13, 1}, {15, 1},
-                                              {17, 1}, {19, 2}, {23, 2},
-                                              {27, 2}, {31, 2}, {35, 3},
-                                              {43, 3}, {51, 3}, {59, 3},
-                                              {67, 4}, {83, 4}, {99, 4},
-                                              {115, 4}, {131, 5}, {163, 5},
-                                              {195, 5}, {227, 5}, {258, 0}};
-
-
-// {distance, extra_bits} for distance codes 0 to 29
-// ref: https://www.ietf.org/rfc/rfc1951.txt section 3.2.5
-static struct value_and_bits dist_data[] = {{1, 0}, {2, 0}, {3, 0}, {4, 0},
-                                            {5, 1}, {7, 1}, {9, 2}, {13, 2},
-                                            {17, 3}, {25, 3}, {33, 4}, {49, 4},
-                                            {65, 5}, {97, 5}, {129, 6},
-                                            {193, 6}, {257, 7}, {385, 7},
-                                            {513, 8}, {769, 8}, {1025, 9},
-                                            {1537, 9}, {2049, 10}, {3073, 10},
-                                            {4097, 11}, {6145, 11}, {8193, 12},
-                                            {12289, 12}, {16385, 13},
-                                            {24577, 13}};
-
-
 // return false if invalid member header
-static bool check_member_header(uint8_t *buf, size_t buf_len, size_t *buf_pos)
+bool check_member_header(uint8_t *buf, size_t buf_len, size_t *buf_pos,
+                         struct member_header *header)
 {
     size_t pos = *buf_pos;
 
     if (pos >= buf_len || buf_len - pos < 10) {
-        fprintf(stderr, "Unexpected buffer length. Expecting at least 10 bytes "
-                "for member header\n");
+        log_error("Unexpected buffer length. Expecting at least 10 bytes "
+                  "for member header\n");
         return false;
     }
 
     uint8_t ID1 = buf[pos++];
     if (ID1 != 0x1f) {
-        fprintf(stderr, "Invalid ID1 byte\n");
+        log_error("Invalid ID1 byte\n");
         return false;
     }
 
     uint8_t ID2 = buf[pos++];
     if (ID2 != 0x8b) {
-        fprintf(stderr, "Invalid ID2 byte\n");
+        log_error("Invalid ID2 byte\n");
         return false;
     }
 
     uint8_t CM = buf[pos++];
     if (CM != 8) {
-        fprintf(stderr, "Unknown compression method\n");
+        log_error("Unknown compression method\n");
         return false;
     }
 
@@ -97,42 +99,44 @@ static bool check_member_header(uint8_t *buf, size_t buf_len, size_t *buf_pos)
     // to be compliant we need to return error
     // if reserved bits are set to non-zero
     if (RESERVED_BIT_5 || RESERVED_BIT_6 || RESERVED_BIT_7) {
-        fprintf(stderr, "Reserved bits should be set to zero\n");
+        log_error("Reserved bits should be set to zero\n");
         return false;
     }
 
     // multi-byte numbers are stored with the least significant byte first
-    uint32_t MTIME = buf[pos] + 256 * buf[pos + 1] + 65536 * buf[pos + 2] +
-        16777216 * buf[pos + 3];
+    uint32_t MTIME = buf[pos] + 256u * buf[pos + 1] + 65536u * buf[pos + 2] +
+        16777216u * buf[pos + 3];
     pos += 4;
 
     uint8_t XFL = buf[pos++];
     uint8_t OS = buf[pos++];
 
+    uint8_t *extra = NULL;
     uint16_t XLEN = 0;
     if (FEXTRA) {
         if (pos >= buf_len || buf_len - pos < 2) {
-            fprintf(stderr, "Unexpected buffer length\n");
+            log_error("Unexpected buffer length\n");
             return false;
         }
         XLEN = buf[pos] + 256 * buf[pos + 1];
         pos += 2;
         if (pos >= buf_len || buf_len - pos < XLEN) {
-            fprintf(stderr, "Unexpected buffer length\n");
+            log_error("Unexpected buffer length\n");
             return false;
         }
+        extra = buf + pos;
         pos += XLEN;
     }
 
     //original file name, zero-terminated
     if (FNAME) {
         if (pos >= buf_len) {
-            fprintf(stderr, "Unexpected buffer length\n");
+            log_error("Unexpected buffer length\n");
             return false;
         }
         while (buf[pos++]) {
             if (pos >= buf_len) {
-                fprintf(stderr, "Unexpected buffer length\n");
+                log_error("Unexpected buffer length\n");
                 return false;
             }
         }
@@ -141,12 +145,12 @@ static bool check_member_header(uint8_t *buf, size_t buf_len, size_t *buf_pos)
     // file comment, zero-terminated
     if (FCOMMENT) {
         if (pos >= buf_len) {
-            fprintf(stderr, "Unexpected buffer length\n");
+            log_error("Unexpected buffer length\n");
             return false;
         }
         while (buf[pos++]) {
             if (pos >= buf_len) {
-                fprintf(stderr, "Unexpected buffer length\n");
+                log_error("Unexpected buffer length\n");
                 return false;
             }
         }
@@ -155,744 +159,967 @@ static bool check_member_header(uint8_t *buf, size_t buf_len, size_t *buf_pos)
     uint16_t CRC16 = 0;
     if (FHCRC) {
         if (pos >= buf_len || buf_len - pos < 2) {
-            fprintf(stderr, "Unexpected buffer length\n");
+            log_error("Unexpected buffer length\n");
             return false;
         }
         CRC16 = buf[pos] + 256 * buf[pos + 1];
         pos += 2;
     }
 
+    header->FLG = FLG;
+    header->MTIME = MTIME;
+    header->XFL = XFL;
+    header->OS = OS;
+    header->extra = extra;
+    header->XLEN = XLEN;
+
     *buf_pos = pos;
     return true;
 }
 
+// FEXTRA consists of subfields of SI1, SI2, a 2 byte LEN and LEN bytes of
+// data, return false if the subfield isn't present or the field is malformed
+// ref: https://www.rfc-editor.org/rfc/rfc1952.txt section 2.3.1.1
+bool find_extra_subfield(struct member_header *header, uint8_t SI1, uint8_t SI2,
+                         uint8_t **data, uint16_t *len)
+{
+    if (header->extra == NULL)
+        return false;
+
+    size_t pos = 0;
+    while (header->XLEN - pos >= 4) {
+        uint8_t *subfield = header->extra + pos;
+        uint16_t LEN = subfield[2] + 256 * subfield[3];
+        pos += 4;
+        if (header->XLEN - pos < LEN)
+            return false;
+
+        if (subfield[0] == SI1 && subfield[1] == SI2) {
+            *data = subfield + 4;
+            *len = LEN;
+            return true;
+        }
+        pos += LEN;
+    }
+
+    return false;
+}
+
 // return false if invalid member trailer
-static bool check_member_trailer(uint8_t *buf, size_t buf_len, size_t *buf_pos)
+// crc and size are of the decompressed data of the member
+static bool check_member_trailer(uint8_t *buf, size_t buf_len, size_t *buf_pos,
+                                 uint32_t crc, uint64_t size)
 {
     size_t pos = *buf_pos;
 
     if (pos >= buf_len || buf_len - pos < 8) {
-        fprintf(stderr, "Unexpected buffer length. Expecting 8 bytes "
-                "after compressed blocks for CRC32 and ISIZE\n");
+        log_error("Unexpected buffer length. Expecting 8 bytes "
+                  "after compressed blocks for CRC32 and ISIZE\n");
         return false;
     }
 
-    // we don't yet check for error using the CRC values which isn't a
-    // requirement to be compliant
-
     // multi-byte numbers are stored with the least significant byte first
-    uint32_t CRC_32 = buf[pos] + 256 * buf[pos + 1] + 65536 * buf[pos + 2] +
-        16777216 * buf[pos + 3];
+    uint32_t CRC_32 = buf[pos] + 256u * buf[pos + 1] + 65536u * buf[pos + 2] +
+        16777216u * buf[pos + 3];
     pos += 4;
-    uint32_t ISIZE = buf[pos] + 256 * buf[pos + 1] + 65536 * buf[pos + 2] +
-        16777216 * buf[pos + 3];
+    uint32_t ISIZE = buf[pos] + 256u * buf[pos + 1] + 65536u * buf[pos + 2] +
+        16777216u * buf[pos + 3];
     pos += 4;
 
-    *buf_pos = pos;
-    return true;
-}
+    if (CRC_32 != crc) {
+        log_error("CRC32 doesn't match decompressed data\n");
+        return false;
+    }
 
-static inline void increment_bit_position(struct decompression_data *data)
-{
-    if (data->byte_pos == 7) {
-        data->byte_pos = 0;
-        data->buf_pos++;
-        return;
+    // size of the original input data modulo 2^32
+    if (ISIZE != (uint32_t) size) {
+        log_error("ISIZE doesn't match decompressed data size\n");
+        return false;
     }
 
-    data->byte_pos++;
+    *buf_pos = pos;
+    return true;
 }
 
-static inline bool is_length_code(int16_t code)
+bool output_size_hint(uint8_t *buf, size_t buf_len, uint64_t *size)
 {
-    return code >= 257 && code <= 285;
-}
+    // the smallest member is a header, an empty block and a trailer
+    if (buf_len < 20)
+        return false;
 
-static inline bool is_literal_code(int16_t code)
-{
-    return code >= 0 && code <= 255;
-}
+    size_t pos = buf_len - 4;
+    uint32_t ISIZE = buf[pos] + 256u * buf[pos + 1] + 65536u * buf[pos + 2] +
+        16777216u * buf[pos + 3];
+    if (ISIZE == 0 || ISIZE / MAX_DEFLATE_RATIO > buf_len)
+        return false;
 
-static inline bool is_literal_length_code(int16_t code)
-{
-    return code >= 0 && code <= 285;
+    *size = ISIZE;
+    return true;
 }
 
-static inline bool is_distance_code(int16_t code)
+// the CRC32 is updated while the output is still in cache, or handed
+// to the crc worker which processes it while decoding goes on
+static bool write_out_buf(struct decompression_data *data)
 {
-    return code >= 0 && code <= 29;
-}
+    const uint8_t *chunk = data->out_buf + data->write_pos;
+    size_t len = data->out_pos - data->write_pos;
+    if (data->crc_worker_started)
+        crc_worker_submit(&data->crc_worker, chunk, len);
+    else
+        data->crc = crc32_update(data->crc, chunk, len);
+
+    // only output from out_skip up to out_limit is written
+    uint64_t start = data->size;
+    uint64_t end = data->size + len;
+    if (start < data->out_skip)
+        start = data->out_skip < end ? data->out_skip : end;
+    if (end > data->out_limit)
+        end = data->out_limit > start ? data->out_limit : start;
+
+    size_t n = (size_t) (end - start);
+    if (data->in_place)
+        sink_commit(data->sink, n);
+    else if (!write_sink(data->sink, chunk + (start - data->size), n))
+        return false;
+    data->size += len;
+    data->write_pos = data->out_pos;
 
-static inline bool is_code_length_code(int16_t code)
-{
-    return code >= 0 && code <= 18;
+    return true;
 }
 
-static bool handle_literal_codes(struct decompression_data *data,
-                                 uint8_t *codes, uint16_t len)
+// the worker is only started for members which fill the output buffer,
+// decoding falls back to computing the CRC32 itself if starting fails
+static void start_crc_worker(struct decompression_data *data)
 {
-    for (uint16_t i = 0; i < len; ++i) {
-        if (data->out_pos == OUT_BUF_SIZE) {
-            if (fwrite(data->out_buf, 1, data->out_pos, data->f) !=
-                data->out_pos) {
-                fprintf(stderr, "Could not write full buffer\n");
-                return false;
-            }
-            data->out_pos = 0;
-        }
-        data->out_buf[data->out_pos++] = codes[i];
-        data->back_refs[data->back_refs_pos] = codes[i];
-        data->back_refs_pos = (data->back_refs_pos + 1) % MAX_DISTANCE;
-        if (!data->back_refs_filled && data->back_refs_pos == 0)
-            data->back_refs_filled = true;
+    // output decoded in place isn't overwritten, there is no need for a
+    // spare buffer
+    if (!data->in_place) {
+        data->spare_buf = malloc(data->out_buf_size);
+        if (data->spare_buf == NULL)
+            return;
     }
 
-    // could be that at the end of the loop we have full buffer
-    if (data->out_pos == OUT_BUF_SIZE) {
-        if (fwrite(data->out_buf, 1, data->out_pos, data->f) != data->out_pos) {
-            fprintf(stderr, "Could not write full buffer\n");
-            return false;
-        }
-        data->out_pos = 0;
+    if (!crc_worker_start(&data->crc_worker)) {
+        free(data->spare_buf);
+        data->spare_buf = NULL;
+        return;
     }
 
-    return true;
+    data->crc_worker.crc = data->crc;
+    data->crc_worker_started = true;
+    return;
 }
 
-static bool decompress_block_type_00(struct decompression_data *data)
+// output decoded in place stays where it is, decoding goes on after it
+// in the room left in the sink or in a buffer of its own once the room
+// runs out
+static bool move_in_place(struct decompression_data *data, size_t keep)
 {
-    if (data->byte_pos != 0) {
-        data->buf_pos++;
-        data->byte_pos = 0;
-    }
-
-    if (data->buf_pos >= data->buf_len || data->buf_len - data->buf_pos < 4) {
-        fprintf(stderr, "Unexpected buffer length\n");
-        return false;
-    }
-
-    uint16_t LEN = data->buf[data->buf_pos] +
-        256 * data->buf[data->buf_pos + 1];
-    uint16_t NLEN = data->buf[data->buf_pos + 2] +
-        256 * data->buf[data->buf_pos + 3];
-
-    data->buf_pos += 4;
-
-    if (LEN != (uint16_t) (~NLEN)) {
-        fprintf(stderr, "LEN doesn't match ~NLEN in block type 00\n");
-        return false;
-    }
-
-    if (data->buf_pos >= data->buf_len || data->buf_len - data->buf_pos < LEN) {
-        fprintf(stderr, "Unexpected buffer length\n");
-        return false;
+    size_t room = sink_room(data->sink);
+    if (room > FAST_OUTPUT_MARGIN) {
+        data->out_buf += data->out_pos - keep;
+        data->out_buf_size = keep + (room < data->write_size ? room :
+                                     data->write_size);
+        return true;
     }
 
-    bool success = handle_literal_codes(data, data->buf + data->buf_pos, LEN);
-    if (!success) {
-        fprintf(stderr, "Failed to handle literal codes in block type 00\n");
+    size_t size = MAX_DISTANCE + data->write_size;
+    uint8_t *out_buf = malloc(size);
+    uint8_t *spare_buf = data->crc_worker_started ? malloc(size) : NULL;
+    if (out_buf == NULL || (data->crc_worker_started && spare_buf == NULL)) {
+        log_error("Failed to allocate output buffer\n");
+        free(out_buf);
+        free(spare_buf);
         return false;
     }
-    data->buf_pos += LEN;
 
+    // the sink is unmapped on the next write, which the worker may not
+    // be reading from anymore by then
+    memcpy(out_buf, data->out_buf + data->out_pos - keep, keep);
+    if (data->crc_worker_started)
+        crc_worker_wait(&data->crc_worker);
+    data->out_buf = out_buf;
+    data->spare_buf = spare_buf;
+    data->out_buf_size = size;
+    data->in_place = false;
     return true;
 }
 
-// bits in order from lsb to msb
-static bool read_bits(struct decompression_data *data, uint8_t bits,
-                      uint16_t *bits_value)
+// write the output and move the last 32768 bytes to the front
+static bool flush_out_buf(struct decompression_data *data)
 {
-    uint16_t tmp = 0;
-    for (uint8_t i = 0; i < bits; ++i) {
-        if (data->buf_pos >= data->buf_len) {
-            fprintf(stderr, "Unexpected buffer length\n");
+    if (data->crc_thread && !data->crc_worker_started)
+        start_crc_worker(data);
+
+    if (!write_out_buf(data))
+        return false;
+
+    size_t keep = data->out_pos < MAX_DISTANCE ? data->out_pos : MAX_DISTANCE;
+    if (data->in_place) {
+        if (!move_in_place(data, keep))
             return false;
-        }
-        bool bit = (data->buf[data->buf_pos] >> data->byte_pos) & 1;
-        increment_bit_position(data);
-        if (bit)
-            tmp |= (uint16_t) (1u << i);
+    } else if (data->crc_worker_started) {
+        // the worker is done with the spare buffer once it got the chunk
+        // of this one, decoding continues in the spare buffer
+        memcpy(data->spare_buf, data->out_buf + data->out_pos - keep, keep);
+        uint8_t *tmp = data->out_buf;
+        data->out_buf = data->spare_buf;
+        data->spare_buf = tmp;
+    } else {
+        memmove(data->out_buf, data->out_buf + data->out_pos - keep, keep);
     }
-
-    *bits_value = tmp;
+    data->out_pos = keep;
+    data->write_pos = keep;
 
     return true;
 }
 
-static struct node *find_huffman_code(struct decompression_data *data,
-                                      struct node *root)
+static bool handle_literal_codes(struct decompression_data *data,
+                                 const uint8_t *codes, uint16_t len)
 {
-    if (root == NULL) {
-        fprintf(stderr, "Unexpected NULL node given to find huffman code\n");
-        return NULL;
-    }
-
-    struct node *cur = root;
-    while (cur->code == -1) {
-        if (data->buf_pos >= data->buf_len) {
-            fprintf(stderr, "Unexpected buffer length\n");
-            return false;
-        }
-        bool bit = (data->buf[data->buf_pos] >> data->byte_pos) & 1;
-        increment_bit_position(data);
-        cur = bit ? cur->right : cur->left;
-        if (cur == NULL) {
-            fprintf(stderr, "Unexpected NULL node trying to find "
-                    "huffman code\n");
-            return NULL;
+    while (len) {
+        if (data->out_pos == data->out_buf_size) {
+            if (!flush_out_buf(data))
+                return false;
         }
+
+        size_t space = data->out_buf_size - data->out_pos;
+        size_t n = len < space ? len : space;
+        memcpy(data->out_buf + data->out_pos, codes, n);
+        data->out_pos += n;
+        codes += n;
+        len -= n;
     }
 
-    return cur;
+    return true;
 }
 
-static bool length_from_length_code(struct decompression_data *data,
-                                    uint16_t code, uint16_t *length)
+static bool decompress_block_type_00(struct decompression_data *data)
 {
-    if (!is_length_code(code)) {
-        fprintf(stderr, "Expecting valid length code\n");
+    struct bit_reader *in = &data->in;
+    align_to_byte(in);
+    if (bit_reader_overrun(in)) {
+        log_error("Unexpected buffer length\n");
         return false;
     }
 
-    uint16_t length_start = length_data[code - 257].value;
-    uint8_t extra_bits = length_data[code - 257].extra_bits;
-    uint16_t extra_bits_value = 0;
-    bool success = read_bits(data, extra_bits, &extra_bits_value);
-    if (!success) {
-        fprintf(stderr, "Failed to read extra length bits\n");
+    size_t pos = bit_reader_byte_position(in);
+    if (!bit_reader_ensure_bytes(in, &pos, 4)) {
+        log_error("Unexpected buffer length\n");
         return false;
     }
 
-    // for byte 284 extra bits of length 5 don't use the last possible
-    // value 31 (11111) which would make the length 227 + 31 = 258.
-    // 258 has separate length code 285
-    if (code == 284 && extra_bits_value == 31) {
-        fprintf(stderr, "Unexpected length extra value 31 for code 284\n");
-        return false;
-    }
+    uint16_t LEN = in->buf[pos] + 256 * in->buf[pos + 1];
+    uint16_t NLEN = in->buf[pos + 2] + 256 * in->buf[pos + 3];
 
-    uint16_t len = length_start + extra_bits_value;
-    if (len > 258 || len < 3) {
-        fprintf(stderr, "Expecting length to be between 3 and 258\n");
+    pos += 4;
+
+    if (LEN != (uint16_t) (~NLEN)) {
+        log_error("LEN doesn't match ~NLEN in block type 00\n");
         return false;
     }
 
-    *length = len;
-    return true;
-}
-
-static bool distance_from_distance_code(struct decompression_data *data,
-                                        uint8_t code, uint16_t *distance)
-{
-    if (!is_distance_code(code)) {
-        fprintf(stderr, "Expecting valid distance code\n");
+    if (!bit_reader_ensure_bytes(in, &pos, LEN)) {
+        log_error("Unexpected buffer length\n");
         return false;
     }
 
-    uint16_t distance_start = dist_data[code].value;
-    uint8_t extra_bits = dist_data[code].extra_bits;
-    uint16_t extra_bits_value = 0;
-    bool success = read_bits(data, extra_bits, &extra_bits_value);
+    // the stored bytes are copied into out_buf with memcpy like other
+    // output instead of going from the input to the sink with writev,
+    // copy_file_range or splice. Headers split the input every 65535
+    // bytes at most, which would make that a system call per block, and
+    // the CRC32 would be computed on input that isn't in cache
+    bool success = handle_literal_codes(data, in->buf + pos, LEN);
     if (!success) {
-        fprintf(stderr, "Failed to read distance extra bits\n");
+        log_error("Failed to handle literal codes in block type 00\n");
         return false;
     }
 
-    uint16_t dist = distance_start + extra_bits_value;
-    if (dist < 1 || dist > 32768) {
-        fprintf(stderr, "Expecting distance to be between 1 and 32768\n");
-        return false;
-    }
+    // bits loaded after the stored block header are dropped and
+    // reading continues after the stored bytes
+    bit_reader_seek(in, pos + LEN);
 
-    *distance = dist;
     return true;
 }
 
 static bool copy_bytes_from_distance(struct decompression_data *data,
                                      uint16_t length, uint16_t distance)
 {
-    uint16_t copy_start_pos = (data->back_refs_pos - distance +
-                               MAX_DISTANCE) % MAX_DISTANCE;
-    if (!data->back_refs_filled &&
-        copy_start_pos >= data->back_refs_pos) {
-        fprintf(stderr, "Invalid back reference for copying bytes\n");
+    if (distance > data->out_pos) {
+        log_error("Invalid back reference for copying bytes\n");
         return false;
     }
-    uint16_t tmp = copy_start_pos;
-    uint8_t bytes_to_copy[258]; // max length 258
-    for (uint16_t i = 0; i < length; ++i) {
-        bytes_to_copy[i] = data->back_refs[tmp];
-        tmp = (tmp + 1) % MAX_DISTANCE;
-        if (tmp == data->back_refs_pos) {
-            tmp = copy_start_pos;
+
+    // flushing keeps the last 32768 bytes so distance stays valid
+    if (data->out_buf_size - data->out_pos < length) {
+        if (!flush_out_buf(data)) {
+            log_error("Failed to flush output buffer\n");
+            return false;
         }
     }
 
-    // now copy them to back_refs and out_buf
-    bool success = handle_literal_codes(data, bytes_to_copy, length);
-    if (!success) {
-        fprintf(stderr, "Failed to handle literal bytes\n");
-        return false;
-    }
+    // copying forward one byte at a time repeats the last distance
+    // bytes when length is more than distance
+    uint8_t *out = data->out_buf + data->out_pos;
+    const uint8_t *from = out - distance;
+    for (uint16_t i = 0; i < length; ++i)
+        out[i] = from[i];
+    data->out_pos += length;
 
     return true;
 }
 
-static bool decompress_block_type_01(struct decompression_data *data)
+// decode without checking input and output lengths for every symbol
+// while there is input left for full word refills, the output buffer
+// is flushed whenever it can't take the longest match anymore. Sets
+// *end_of_block if the end of block code was decoded, otherwise the
+// rest of the block needs to be decoded carefully near input end
+static bool decompress_huffman_block_fast(struct decompression_data *data,
+                                          const struct huffman_table *ll_table,
+                                          const struct huffman_table *d_table,
+                                          bool *end_of_block)
 {
-    uint8_t lengths[288];
-
-    // fixed huffman code lengths for block type 01
-    // ref: https://www.ietf.org/rfc/rfc1951.txt section 3.2.6
-    for (uint8_t i = 0; i < 144; ++i)
-        lengths[i] = 8;
-    for (uint16_t i = 144; i < 256; ++i)
-        lengths[i] = 9;
-    for (uint16_t i = 256; i < 280; ++i)
-        lengths[i] = 7;
-    for (uint16_t i = 280; i <= 287; ++i)
-        lengths[i] = 8;
-
-    struct node *root = create_huffman_tree(lengths, 288, 15);
-    if (root == NULL) {
-        fprintf(stderr, "Failed to create huffman tree in block type 01\n");
-        return false;
-    }
+    // local copies so that output stores can't alias the decoding state
+    struct bit_reader in = data->in;
+    uint8_t *out = data->out_buf + data->out_pos;
+    uint8_t *out_end = data->out_buf + data->out_buf_size -
+        FAST_OUTPUT_MARGIN;
+    bool success = true;
+
+    while (in.buf_len - in.buf_pos >= FAST_INPUT_MARGIN) {
+        if (out > out_end) {
+            data->out_pos = (size_t) (out - data->out_buf);
+            if (!flush_out_buf(data)) {
+                success = false;
+                break;
+            }
+            out = data->out_buf + data->out_pos;
+            out_end = data->out_buf + data->out_buf_size -
+                FAST_OUTPUT_MARGIN;
+        }
 
-    while (true) {
-        struct node *edge_node = find_huffman_code(data, root);
-        if (edge_node == NULL) {
-            fprintf(stderr, "Could not find huffman code in block type 01\n");
-            return false;
+        // a literal/length code with its extra bits and a distance code
+        // with its extra bits take at most 48 bits, so literals are
+        // decoded without refilling until less than that is left
+        if (in.bit_cnt < 48)
+            refill_bits_fast(&in);
+
+        uint64_t bits = peek_bits(&in);
+        const struct huffman_entry *entry =
+            &ll_table->entries[bits & ((1u << ll_table->primary_bits) - 1)];
+        if (is_link(entry)) {
+            uint32_t index = (bits >> ll_table->primary_bits) &
+                ((1u << entry->sub_bits) - 1);
+            entry = &ll_table->entries[entry->symbol + index];
         }
-        if (!is_literal_length_code(edge_node->code)) {
-            fprintf(stderr, "Invalid literal length code in block type 01\n");
-            return false;
+        if (entry->sub_bits == 0 && is_literal_code(entry->symbol) &&
+            entry->len != 0) {
+            *out++ = (uint8_t) entry->symbol;
+            consume_bits(&in, entry->len);
+            continue;
         }
-        uint16_t code = (uint16_t) edge_node->code;
-        // block end marker
-        if (code == 256)
+        if (entry->sub_bits == LITERAL_PAIR) {
+            out[0] = (uint8_t) entry->symbol;
+            out[1] = (uint8_t) (entry->symbol >> 8);
+            out += 2;
+            consume_bits(&in, entry->len);
+            continue;
+        }
+        if (entry->len == 0) {
+            log_error("Invalid huffman code for literal length\n");
+            success = false;
             break;
+        }
+        consume_bits(&in, entry->len);
 
-        if (is_literal_code(code)) {
-            uint8_t byte = (uint8_t) code;
-            bool success = handle_literal_codes(data, &byte, 1);
-            if (!success) {
-                fprintf(stderr, "Failed to handle literal code in "
-                        "block type 01\n");
+        if (entry->sub_bits == 0) {
+            // block end marker
+            if (entry->symbol == 256) {
+                *end_of_block = true;
+                break;
+            }
+
+            log_error("Invalid literal length code\n");
+            success = false;
+            break;
+        }
+
+        // 258 has separate length code 285
+        uint16_t length = take_value(&in, entry);
+        if (entry->sub_bits == VALUE_EXTRA + 5 && length == 258) {
+            log_error("Unexpected length extra value 31 for code 284\n");
+            success = false;
+            break;
+        }
+
+        entry = lookup_entry(d_table, peek_bits(&in));
+        if (entry->len == 0) {
+            log_error("Invalid huffman code for distance\n");
+            success = false;
+            break;
+        }
+        consume_bits(&in, entry->len);
+        if (entry->sub_bits == 0) {
+            log_error("Expecting valid distance code\n");
+            success = false;
+            break;
+        }
+
+        uint16_t distance = take_value(&in, entry);
+        if (distance > out - data->out_buf) {
+            log_error("Invalid back reference for copying bytes\n");
+            success = false;
+            break;
+        }
+
+        copy_match(out, distance, length);
+        out += length;
+    }
+
+    data->in = in;
+    data->out_pos = (size_t) (out - data->out_buf);
+    return success;
+}
+
+// decode symbols one at a time while the input buffer has less than
+// FAST_INPUT_MARGIN bytes left, sets *end_of_block if the end of block
+// code was decoded
+static bool decompress_huffman_symbols(struct decompression_data *data,
+                                       const struct huffman_table *ll_table,
+                                       const struct huffman_table *d_table,
+                                       bool *end_of_block)
+{
+    struct bit_reader *in = &data->in;
+    bool success = true;
+
+    while (in->buf_len - in->buf_pos < FAST_INPUT_MARGIN) {
+        // a literal/length code with its extra bits and a distance code
+        // with its extra bits take at most 48 bits which fit in one refill
+        refill_bits(in);
+
+        const struct huffman_entry *entry = &ll_table->entries[
+            peek_bits(in) & ((1u << ll_table->primary_bits) - 1)];
+        if (entry->sub_bits == LITERAL_PAIR) {
+            consume_bits(in, entry->len);
+            if (bit_reader_overrun(in)) {
+                log_error("Unexpected buffer length\n");
                 return false;
             }
-        } else if (is_length_code(code)) {
-            uint16_t length = 0;
-            bool success = length_from_length_code(data, code, &length);
+
+            uint8_t bytes[2] = {(uint8_t) entry->symbol,
+                                (uint8_t) (entry->symbol >> 8)};
+            success = handle_literal_codes(data, bytes, 2);
             if (!success) {
-                fprintf(stderr, "Failed to get length from length code "
-                        "in block type 01\n");
+                log_error("Failed to handle literal code\n");
                 return false;
             }
+            continue;
+        }
 
-            // fixed 5 bits for distance codes
-            uint16_t tmp = 0;
-            success = read_bits(data, 5, &tmp);
-            if (!success) {
-                fprintf(stderr, "Failed to read distance code in "
-                        "block type 01\n");
+        entry = lookup_entry(ll_table, peek_bits(in));
+        if (entry->len == 0) {
+            log_error("Could not find huffman code for literal "
+                      "length\n");
+            return false;
+        }
+        consume_bits(in, entry->len);
+
+        if (entry->sub_bits == 0) {
+            uint16_t code = entry->symbol;
+            if (!is_literal_code(code) && code != 256) {
+                log_error("Invalid literal length code\n");
                 return false;
             }
-            uint8_t distance_code = (uint8_t) tmp;
-            uint16_t distance = 0;
-            success = distance_from_distance_code(data, distance_code,
-                                                  &distance);
-            if (!success) {
-                fprintf(stderr, "Failed to get distance from distance code "
-                        "in block type 01\n");
+            if (bit_reader_overrun(in)) {
+                log_error("Unexpected buffer length\n");
                 return false;
             }
-            success = copy_bytes_from_distance(data, length, distance);
+            // block end marker
+            if (code == 256) {
+                *end_of_block = true;
+                break;
+            }
+
+            uint8_t byte = (uint8_t) code;
+            success = handle_literal_codes(data, &byte, 1);
             if (!success) {
-                fprintf(stderr, "Failed to copy bytes from back reference "
-                        "in block type 01\n");
+                log_error("Failed to handle literal code\n");
                 return false;
             }
+            continue;
+        }
+
+        // 258 has separate length code 285
+        uint16_t length = take_value(in, entry);
+        if (entry->sub_bits == VALUE_EXTRA + 5 && length == 258) {
+            log_error("Unexpected length extra value 31 for code 284\n");
+            return false;
+        }
+
+        entry = lookup_entry(d_table, peek_bits(in));
+        if (entry->len == 0) {
+            log_error("Could not find huffman code for distance\n");
+            return false;
+        }
+        consume_bits(in, entry->len);
+        if (entry->sub_bits == 0) {
+            log_error("Expecting valid distance code\n");
+            return false;
+        }
+
+        uint16_t distance = take_value(in, entry);
+        if (bit_reader_overrun(in)) {
+            log_error("Unexpected buffer length\n");
+            return false;
+        }
+
+        success = copy_bytes_from_distance(data, length, distance);
+        if (!success) {
+            log_error("Failed to copy bytes from back reference\n");
+            return false;
         }
     }
 
-    free_huffman_tree(root);
     return true;
 }
 
-static bool decompress_block_type_10(struct decompression_data *data)
+// decode literal/length and distance codes until the end of block code,
+// the tables have value entries for the length and distance codes
+static bool decompress_huffman_block(struct decompression_data *data,
+                                     const struct huffman_table *ll_table,
+                                     const struct huffman_table *d_table)
 {
-    uint16_t tmp = 0;
+    while (true) {
+        bool end_of_block = false;
+        bool success = decompress_huffman_block_fast(data, ll_table, d_table,
+                                                     &end_of_block);
+        if (!success)
+            return false;
 
-    // HLIT 5 bits, HDIST 5 bits, HCLEN 4 bits
-    // ref: https://www.ietf.org/rfc/rfc1951.txt section 3.2.7
+        if (end_of_block)
+            return true;
 
-    // HLIT
-    bool success = read_bits(data, 5, &tmp);
-    if (!success) {
-        fprintf(stderr, "Failed to read HLIT in block type 10\n");
-        return false;
-    }
-    uint8_t HLIT = (uint8_t) tmp;
-    // number of literal length codes
-    uint16_t ll_code_cnt = (uint16_t) HLIT + 257;
-    if (ll_code_cnt < 257 || ll_code_cnt > 286) {
-        fprintf(stderr, "Expecting ll code count to be between 257 to 285 "
-                " in block type 10\n");
-        return false;
+        // careful decoding near the end of input buffer, until reading
+        // more input makes room for the fast loop again
+        success = decompress_huffman_symbols(data, ll_table, d_table,
+                                             &end_of_block);
+        if (!success)
+            return false;
+
+        if (end_of_block)
+            return true;
     }
+}
 
-    // HDIST
-    success = read_bits(data, 5, &tmp);
+static bool decompress_block_type_01(struct decompression_data *data)
+{
+    bool success = decompress_huffman_block(data, &fixed_ll_value_table,
+                                            &fixed_d_value_table);
     if (!success) {
-        fprintf(stderr, "Failed to read HDIST in block type 10\n");
+        log_error("Failed to decompress huffman codes in "
+                  "block type 01\n");
         return false;
     }
-    uint8_t HDIST = (uint8_t) tmp;
-    // number of distance codes
-    uint8_t d_code_cnt = HDIST + 1;
-    if (d_code_cnt < 1 || d_code_cnt > 32) {
-        fprintf(stderr, "Expecting distance code count to be between "
-                "1 to 31 in block type 10\n");
+
+    return true;
+}
+
+static uint64_t monotonic_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + (uint64_t) ts.tv_nsec;
+}
+
+static bool decompress_block_type_10(struct decompression_data *data)
+{
+    // text has long runs of literals with short codes, which take one
+    // lookup for every two of them with literal pairs in the wider
+    // tables. Those take longer to build, so the width is chosen from the
+    // code lengths and the output the block is expected to have
+    uint64_t created = data->stats != NULL ? monotonic_ns() : 0;
+    struct huffman_table ll_table;
+    struct huffman_table d_table;
+    struct huffman_entry ll_entries[MAX_LL_TABLE_ENTRIES];
+    struct huffman_entry d_entries[D_TABLE_ENTRIES];
+    bool success = read_dynamic_tables(&data->in, data->last_block_size,
+                                       true, &ll_table, ll_entries, &d_table,
+                                       d_entries);
+    if (!success)
         return false;
-    }
+    if (ll_table.primary_bits > LL_PRIMARY_BITS)
+        add_literal_pairs(ll_entries, ll_table.primary_bits);
 
-    // HCLEN
-    success = read_bits(data, 4, &tmp);
+    uint64_t decoded = data->stats != NULL ? monotonic_ns() : 0;
+    uint64_t start = data->size + data->out_pos - data->write_pos;
+    success = decompress_huffman_block(data, &ll_table, &d_table);
     if (!success) {
-        fprintf(stderr, "Failed to read HCLEN in block type 10\n");
+        log_error("Failed to decompress huffman codes in "
+                  "block type 10\n");
         return false;
     }
-    uint8_t HCLEN = (uint8_t) tmp;
-    // number of code length codes
-    uint8_t cl_code_cnt = HCLEN + 4;
-    if (cl_code_cnt < 4 || cl_code_cnt > 19) {
-        fprintf(stderr, "Expecting cl code count to be between "
-                "4 and 18 in block type 10\n");
-        return false;
+    data->last_block_size = data->size + data->out_pos - data->write_pos -
+        start;
+
+    if (data->stats != NULL) {
+        uint8_t bits = ll_table.primary_bits;
+        data->stats->blocks[bits]++;
+        data->stats->output[bits] += data->last_block_size;
+        data->stats->create_ns[bits] += decoded - created;
+        data->stats->decode_ns[bits] += monotonic_ns() - decoded;
     }
 
-    // ref: https://www.rfc-editor.org/rfc/rfc1951.txt section 3.2.7
-    uint8_t cl_code_serial[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12,
-                                  3, 13, 2, 14, 1, 15};
-    uint8_t cl_code_lengths[19];
-    for (uint8_t i = 0; i < 19; ++i)
-        cl_code_lengths[i] = 0;
+    return true;
+}
 
-    for (uint8_t i = 0; i < cl_code_cnt; ++i) {
-        // cl code lengths are 3 bits each
-        success = read_bits(data, 3, &tmp);
-        if (!success) {
-            fprintf(stderr, "Failed to read code length code in "
-                    "block type 10\n");
-            return false;
-        }
-        cl_code_lengths[cl_code_serial[i]] = (uint8_t) tmp;
+// window holds the window_len bytes of output preceding the blocks, the
+// output buffer keeps the last 32768 decompressed bytes at its front
+// after writing write_size bytes, back references are then copies from
+// earlier in the same buffer. A member is decoded in place if the sink
+// has room for it, like a mapped output file
+static bool init_decompression_data(struct decompression_data *data,
+                                    const uint8_t *window, size_t window_len,
+                                    struct sink *sink, size_t write_size,
+                                    bool crc_thread)
+{
+    size_t room = window_len == 0 ? sink_room(sink) : 0;
+    data->write_size = write_size;
+    data->out_buf_size = MAX_DISTANCE + write_size;
+    data->in_place = room > FAST_OUTPUT_MARGIN;
+    if (data->in_place) {
+        if (room < data->out_buf_size)
+            data->out_buf_size = room;
+        data->out_buf = sink->buf + sink->len;
+    } else {
+        data->out_buf = malloc(data->out_buf_size);
     }
-
-    struct node *cl_root = create_huffman_tree(cl_code_lengths, 19, 7);
-    if (cl_root == NULL) {
-        fprintf(stderr, "Failed to generate binary tree for block type 10\n");
+    if (data->out_buf == NULL) {
+        log_error("Failed to allocate output buffer\n");
         return false;
     }
 
-    uint8_t ll_code_lengths[286];
-    for (uint16_t i = 0; i < 286; ++i)
-        ll_code_lengths[i] = 0;
+    if (window_len > MAX_DISTANCE) {
+        window += window_len - MAX_DISTANCE;
+        window_len = MAX_DISTANCE;
+    }
+    if (window_len)
+        memcpy(data->out_buf, window, window_len);
+
+    data->crc_thread = crc_thread;
+    data->crc_worker_started = false;
+    data->spare_buf = NULL;
+    data->last_block_size = FIRST_BLOCK_SIZE;
+    data->stats = NULL;
+    data->out_pos = window_len;
+    data->write_pos = window_len;
+    data->crc = 0;
+    data->size = 0;
+    data->sink = sink;
+    data->out_skip = 0;
+    data->out_limit = UINT64_MAX;
+    data->index = NULL;
+    return true;
+}
 
-    uint8_t d_code_lengths[32];
-    for (uint8_t i = 0; i < 32; ++i)
-        d_code_lengths[i] = 0;
+// writes the rest of the output, sets crc and size of all of it
+static bool finish_decompression_data(struct decompression_data *data,
+                                      bool success, uint32_t *crc,
+                                      uint64_t *size)
+{
+    if (success)
+        success = write_out_buf(data);
+
+    if (data->crc_worker_started) {
+        data->crc = crc_worker_wait(&data->crc_worker);
+        crc_worker_stop(&data->crc_worker);
+    }
+    if (!data->in_place)
+        free(data->out_buf);
+    free(data->spare_buf);
 
-    // The code length repeat codes can cross from HLIT + 257 to the
-    // HDIST + 1 code lengths.  In other words, all code lengths form
-    // a single sequence of HLIT + HDIST + 258 values.
-    // ref: https://www.rfc-editor.org/rfc/rfc1951.txt section 3.2.7
+    *crc = data->crc;
+    *size = data->size;
+    return success;
+}
+
+// a checkpoint is added at a block boundary once span bytes of output
+// followed the previous one
+static bool add_index_checkpoint(struct decompression_data *data)
+{
+    struct gzip_index *index = data->index;
+    uint64_t out_pos = index->out_size + data->size + data->out_pos -
+        data->write_pos;
+    if (out_pos - index->points[index->cnt - 1].out_pos < index->span)
+        return true;
+
+    size_t keep = data->out_pos < MAX_DISTANCE ? data->out_pos : MAX_DISTANCE;
+    return add_checkpoint(index, out_pos, bit_reader_bit_position(&data->in),
+                          false, data->out_buf + data->out_pos - keep, keep);
+}
 
-    uint8_t previous_code_length = 0;
-    uint16_t total = ll_code_cnt + d_code_cnt;
-    uint16_t cnt = 0;
+// decodes blocks until the final one, until the next block would start
+// at or after stop_bit or until out_limit bytes of output
+static bool decode_blocks(struct decompression_data *data, uint64_t stop_bit,
+                          bool *final)
+{
+    *final = false;
 
-    while (cnt < total) {
-        struct node *edge_node = find_huffman_code(data, cl_root);
-        if (edge_node == NULL) {
-            fprintf(stderr, "Could not find huffman code in block type 10\n");
+    while (bit_reader_bit_position(&data->in) < stop_bit &&
+           data->size + data->out_pos - data->write_pos < data->out_limit) {
+        if (data->index != NULL && !add_index_checkpoint(data))
             return false;
-        }
-        if (!is_code_length_code(edge_node->code)) {
-            fprintf(stderr, "Invalid code length code found in "
-                    "block type 10\n");
+
+        // 3 header bits
+        // BFINAL (1 bit), BTYPE (2 bits)
+        uint16_t header = 0;
+        bool success = read_bits(&data->in, 3, &header);
+        if (!success) {
+            log_error("Failed to read block header\n");
             return false;
         }
 
-        uint8_t code = (uint8_t) edge_node->code;
-        if (code == 16 && cnt == 0) {
-            fprintf(stderr, "Repeat code 16 without any previous "
-                    "code length in block type 10\n");
+        bool BFINAL = header & 1;
+        bool BTYPE_LSB = (header >> 1) & 1;
+        bool BTYPE_MSB = (header >> 2) & 1;
+
+        if (BTYPE_MSB == 1 && BTYPE_LSB == 1) {
+            log_error("Error BTYPE\n");
             return false;
         }
 
-        if (code >= 0 && code <= 15) {
-            if (cnt < ll_code_cnt) {
-                ll_code_lengths[cnt] = code;
-            } else {
-                d_code_lengths[cnt - ll_code_cnt] = code;
-            }
-            previous_code_length = code;
-            cnt++;
-        } else if (code == 16) {
-            // extra 2 bits for repeat code 16
-            // 0 = 3, ... , 3 = 6
-            success = read_bits(data, 2, &tmp);
+        if (BTYPE_MSB == 0 && BTYPE_LSB == 0) {
+            success = decompress_block_type_00(data);
             if (!success) {
-                fprintf(stderr, "Failed to read extra 2 bits for "
-                        "code length 16 in block type 10\n");
+                log_error("Failed to decompress block type 00\n");
                 return false;
             }
-            tmp += 3;
-            while (tmp--) {
-                if (cnt >= total) {
-                    fprintf(stderr, "Repeat code exceeds HLIT + HDIST + 258 "
-                            "values in block type 10\n");
-                    return false;
-                }
-                if (cnt < ll_code_cnt) {
-                    ll_code_lengths[cnt] = previous_code_length;
-                } else {
-                    d_code_lengths[cnt - ll_code_cnt] = previous_code_length;
-                }
-                cnt++;
-            }
-        } else if (code == 17 || code == 18) {
-            // copy zero 3 - 10 times (byte == 17)
-            // copy zero 11 - 138 times (byte == 18)
-            uint8_t extra_bits = code == 17 ? 3 : 7;
-            uint8_t plus = code == 17 ? 3 : 11;
-            success = read_bits(data, extra_bits, &tmp);
+        } else if (BTYPE_MSB == 0 && BTYPE_LSB == 1) {
+            success = decompress_block_type_01(data);
             if (!success) {
-                fprintf(stderr, "Failed to read extra bits for repeat code %d "
-                        "in block type 10\n", code);
+                log_error("Failed to decompress block type 01\n");
                 return false;
             }
-            previous_code_length = 0;
-            tmp += plus;
-            while (tmp--) {
-                if (cnt >= total) {
-                    fprintf(stderr, "Repeat code exceeds HLIT + HDIST + 258 "
-                            "values in block type 10\n");
-                    return false;
-                }
-                if (cnt < ll_code_cnt) {
-                    ll_code_lengths[cnt] = 0;
-                } else {
-                    d_code_lengths[cnt - ll_code_cnt] = 0;
-                }
-                cnt++;
+        } else if (BTYPE_MSB == 1 && BTYPE_LSB == 0) {
+            success = decompress_block_type_10(data);
+            if (!success) {
+                log_error("Failed to decompress block type 10\n");
+                return false;
             }
         }
+
+        if (BFINAL) {
+            *final = true;
+            break;
+        }
     }
 
-    free_huffman_tree(cl_root);
+    return true;
+}
 
-    struct node *ll_root = create_huffman_tree(ll_code_lengths, ll_code_cnt,
-                                               15);
-    if (ll_root == NULL) {
-        fprintf(stderr, "Failed to create binary tree ll codes in "
-                "block type 10\n");
+bool decompress_blocks_at(uint8_t *buf, size_t buf_len, uint64_t *bit_pos,
+                          uint64_t stop_bit, const uint8_t *window,
+                          size_t window_len, struct sink *sink, bool *final,
+                          uint32_t *crc, uint64_t *size)
+{
+    struct decompression_data data;
+    if (!init_decompression_data(&data, window, window_len, sink,
+                                 DEFAULT_WRITE_SIZE, false))
         return false;
-    }
+    bit_reader_init_at_bit(&data.in, buf, buf_len, *bit_pos);
+
+    bool success = decode_blocks(&data, stop_bit, final);
+    if (bit_reader_overrun(&data.in))
+        success = false;
+    *bit_pos = bit_reader_bit_position(&data.in);
+
+    return finish_decompression_data(&data, success, crc, size);
+}
 
-    struct node *d_root = create_huffman_tree(d_code_lengths, d_code_cnt, 15);
-    if (d_root == NULL) {
-        fprintf(stderr, "Failed to generate binary tree distance codes "
-                "in block type 10\n");
+bool extract_blocks_at(uint8_t *buf, size_t buf_len, uint64_t bit_pos,
+                       const uint8_t *window, size_t window_len, uint64_t skip,
+                       uint64_t len, struct sink *sink, uint64_t *written)
+{
+    struct decompression_data data;
+    if (!init_decompression_data(&data, window, window_len, sink,
+                                 DEFAULT_WRITE_SIZE, false))
         return false;
-    }
+    data.out_skip = skip;
+    data.out_limit = len < UINT64_MAX - skip ? skip + len : UINT64_MAX;
+    bit_reader_init_at_bit(&data.in, buf, buf_len, bit_pos);
 
-    while (true) {
-        struct node *edge_node = find_huffman_code(data, ll_root);
-        if (edge_node == NULL) {
-            fprintf(stderr, "Failed to find huffman code for length "
-                    "in block type 10\n");
-            return false;
-        }
-        if (!is_literal_length_code(edge_node->code)) {
-            fprintf(stderr, "Expecting valid literal length code "
-                    "in block type 10\n");
-            return false;
-        }
+    bool final = false;
+    bool success = decode_blocks(&data, UINT64_MAX, &final);
 
-        uint16_t code = (uint16_t) edge_node->code;
-        // block end marker
-        if (code == 256)
-            break;
+    uint32_t crc = 0;
+    uint64_t size = 0;
+    success = finish_decompression_data(&data, success, &crc, &size);
 
-        if (is_literal_code(code)) {
-            uint8_t byte = (uint8_t) code;
-            success = handle_literal_codes(data, &byte, 1);
-            if (!success) {
-                fprintf(stderr, "Failed to handle literal code "
-                        "in block type 10\n");
-                return false;
-            }
-        } else if (is_length_code(code)) {
-            uint16_t length = 0;
-            success = length_from_length_code(data, code, &length);
-            if (!success) {
-                fprintf(stderr, "Failed to get length from length code "
-                        "in block type 10\n");
-                return false;
-            }
+    if (size > data.out_limit)
+        size = data.out_limit;
+    *written = size > skip ? size - skip : 0;
+    return success;
+}
 
-            struct node *edge = find_huffman_code(data, d_root);
-            if (edge == NULL) {
-                fprintf(stderr, "Could not find huffman code for distance "
-                        "in block type 10\n");
-                return false;
-            }
+// decodes the blocks of a member starting at in, which is left at the
+// byte after them, sets crc and size of the decompressed data
+static bool decompress_blocks(struct bit_reader *in, struct sink *sink,
+                              struct decompress_options *options,
+                              uint32_t *crc, uint64_t *size)
+{
+    struct decompression_data data;
+    if (!init_decompression_data(&data, NULL, 0, sink, options->write_size,
+                                 options->crc_thread))
+        return false;
+    data.in = *in;
+
+    // every member starts with a checkpoint, there is nothing before it
+    // that back references could reach
+    data.index = options->index;
+    data.stats = options->stats;
+    if (data.index != NULL &&
+        !add_checkpoint(data.index, data.index->out_size,
+                        bit_reader_bit_position(in), true, NULL, 0)) {
+        if (!data.in_place)
+            free(data.out_buf);
+        return false;
+    }
 
-            uint8_t distance_code = (uint8_t) edge->code;
-            uint16_t distance = 0;
-            success = distance_from_distance_code(data, distance_code,
-                                                  &distance);
-            if (!success) {
-                fprintf(stderr, "Failed to get distance from distance code "
-                        "in block type 10\n");
-                return false;
-            }
+    bool final = false;
+    bool success = decode_blocks(&data, UINT64_MAX, &final);
 
-            success = copy_bytes_from_distance(data, length, distance);
-            if (!success) {
-                fprintf(stderr, "Failed to copy from back references "
-                        "in block type 10\n");
-                return false;
-            }
-        }
+    if (success) {
+        // CRC32 starts at (next) byte boundary
+        align_to_byte(&data.in);
+        *in = data.in;
     }
 
-    free_huffman_tree(ll_root);
-    free_huffman_tree(d_root);
+    success = finish_decompression_data(&data, success, crc, size);
+    if (success && data.index != NULL)
+        data.index->out_size += *size;
 
-    return true;
+    return success;
 }
 
-static bool decompress_blocks(uint8_t *buf, size_t buf_len, size_t *buf_pos,
-                              FILE *f)
+bool decompress_member(uint8_t *buf, size_t buf_len, size_t *buf_pos,
+                       struct sink *sink, struct decompress_options *options)
 {
-    uint8_t back_refs[MAX_DISTANCE];
-    uint8_t out_buf[OUT_BUF_SIZE];
+    struct member_header header;
+    bool success = check_member_header(buf, buf_len, buf_pos, &header);
+    if (!success) {
+        log_error("Invalid member header\n");
+        return false;
+    }
 
-    struct decompression_data data;
-    data.buf = buf;
-    data.buf_len = buf_len;
-    data.buf_pos = *buf_pos;
-    data.byte_pos = 0;
-    data.back_refs = back_refs;
-    data.back_refs_pos = 0;
-    data.back_refs_filled = false;
-    data.out_buf = out_buf;
-    data.out_pos = 0;
-    data.f = f;
+    uint32_t crc = 0;
+    uint64_t size = 0;
+    // members spanning several chunks are decompressed speculatively
+    if (options->threads > 1 && options->index == NULL &&
+        options->stats == NULL &&
+        buf_len - *buf_pos > SPECULATIVE_CHUNK_SIZE)
+        success = decompress_blocks_parallel(buf, buf_len, buf_pos, sink,
+                                             options, &crc, &size);
+    else {
+        struct bit_reader in;
+        bit_reader_init(&in, buf, buf_len, *buf_pos);
+        success = decompress_blocks(&in, sink, options, &crc, &size);
+        *buf_pos = bit_reader_byte_position(&in);
+    }
+    if (!success) {
+        log_error("Failed to decompress blocks\n");
+        return false;
+    }
 
-    while (true) {
-        if (data.buf_pos >= data.buf_len) {
-            fprintf(stderr, "Unexpected buffer length\n");
-            return false;
-        }
+    success = check_member_trailer(buf, buf_len, buf_pos, crc, size);
+    if (!success) {
+        log_error("Invalid member trailer\n");
+        return false;
+    }
 
-        // 3 header bits
-        // BFINAL (1 bit)
-        bool BFINAL = (buf[data.buf_pos] >> data.byte_pos) & 1;
-        increment_bit_position(&data);
-        if (data.buf_pos >= data.buf_len) {
-            fprintf(stderr, "Unexpected buffer length\n");
-            return false;
-        }
+    return true;
+}
 
-        // BTYPE (2 bits)
-        bool BTYPE_LSB = (buf[data.buf_pos] >> data.byte_pos) & 1;
-        increment_bit_position(&data);
-        if (data.buf_pos >= data.buf_len) {
-            fprintf(stderr, "Unexpected buffer length\n");
-            return false;
-        }
-        bool BTYPE_MSB = (buf[data.buf_pos] >> data.byte_pos) & 1;
-        increment_bit_position(&data);
-        if (data.buf_pos >= data.buf_len) {
-            fprintf(stderr, "Unexpected buffer length\n");
-            return false;
-        }
+bool decompress_members(uint8_t *buf, size_t buf_len, struct sink *sink,
+                        struct decompress_options *options)
+{
+    if (options->threads > 1 && options->index == NULL &&
+        options->stats == NULL)
+        return decompress_members_parallel(buf, buf_len, sink, options);
 
-        if (BTYPE_MSB == 1 && BTYPE_LSB == 1) {
-            fprintf(stderr, "Error BTYPE\n");
-            return false;
-        }
+    size_t buf_pos = 0;
 
-        if (BTYPE_MSB == 0 && BTYPE_LSB == 0) {
-            bool success = decompress_block_type_00(&data);
-            if (!success) {
-                fprintf(stderr, "Failed to decompress block type 00\n");
-                return false;
-            }
-        } else if (BTYPE_MSB == 0 && BTYPE_LSB == 1) {
-            bool success = decompress_block_type_01(&data);
-            if (!success) {
-                fprintf(stderr, "Failed to decompress block type 01\n");
-                return false;
-            }
-        } else if (BTYPE_MSB == 1 && BTYPE_LSB == 0) {
-            bool success = decompress_block_type_10(&data);
-            if (!success) {
-                fprintf(stderr, "Failed to decompress block type 10\n");
-                return false;
-            }
-        }
+    while (true) {
+        bool success = decompress_member(buf, buf_len, &buf_pos, sink,
+                                         options);
+        if (!success)
+            return false;
 
-        if (BFINAL)
+        if (buf_pos == buf_len)
             break;
     }
 
-    if (data.out_pos) {
-        if (fwrite(data.out_buf, 1, data.out_pos, data.f) != data.out_pos) {
-            fprintf(stderr, "Could not write full buffer\n");
-            return false;
+    return true;
+}
+
+// the member header is parsed again with more input until all of it
+// has been read
+static bool read_stream_member_header(struct bit_reader *in, size_t *pos,
+                                      struct member_header *header)
+{
+    bool quiet = quiet_errors;
+    quiet_errors = true;
+    size_t n = 10;
+    while (true) {
+        size_t header_pos = *pos;
+        if (check_member_header((uint8_t *) in->buf, in->buf_len,
+                                &header_pos, header)) {
+            quiet_errors = quiet;
+            *pos = header_pos;
+            return true;
         }
-        data.out_pos = 0;
+        if (!bit_reader_ensure_bytes(in, pos, n))
+            break;
+        n = in->buf_len - *pos + 1;
     }
+    quiet_errors = quiet;
 
-    // CRC32 starts at (next) byte boundary
-    if (data.byte_pos)
-        data.buf_pos++;
-
-    *buf_pos = data.buf_pos;
-    return true;
+    return check_member_header((uint8_t *) in->buf, in->buf_len, pos, header);
 }
 
-bool decompress_members(uint8_t *buf, size_t buf_len, FILE *f)
+bool decompress_stream(struct input_stream *s, struct sink *sink,
+                       struct decompress_options *options)
 {
-    size_t buf_pos = 0;
+    struct bit_reader in;
+    bit_reader_init(&in, s->buf, s->len, 0);
+    bit_reader_set_fill(&in, fill_input_stream, s);
 
+    size_t pos = 0;
     while (true) {
-        bool success = check_member_header(buf, buf_len, &buf_pos);
+        struct member_header header;
+        bool success = read_stream_member_header(&in, &pos, &header);
         if (!success) {
-            fprintf(stderr, "Invalid member header\n");
+            log_error("Invalid member header\n");
             return false;
         }
 
-        success = decompress_blocks(buf, buf_len, &buf_pos, f);
+        uint32_t crc = 0;
+        uint64_t size = 0;
+        bit_reader_seek(&in, pos);
+        success = decompress_blocks(&in, sink, options, &crc, &size);
         if (!success) {
-            fprintf(stderr, "Failed to decompress blocks\n");
+            log_error("Failed to decompress blocks\n");
             return false;
         }
 
-        success = check_member_trailer(buf, buf_len, &buf_pos);
+        pos = bit_reader_byte_position(&in);
+        bit_reader_ensure_bytes(&in, &pos, 8);
+        success = check_member_trailer((uint8_t *) in.buf, in.buf_len, &pos,
+                                       crc, size);
         if (!success) {
-            fprintf(stderr, "Invalid member trailer\n");
+            log_error("Invalid member trailer\n");
             return false;
         }
 
-        if (buf_pos == buf_len)
+        if (!bit_reader_ensure_bytes(&in, &pos, 1))
             break;
     }
 
@@ -1,10 +1,88 @@
 #ifndef DECOMPRESS
 #define DECOMPRESS
 
+#include "sink.h"
+#include "deflate.h"
+
 #include <inttypes.h>
 #include <stdbool.h>
-#include <stdio.h>
 
-bool decompress_members(uint8_t *buf, size_t buf_len, FILE *f);
+struct gzip_index;
+struct input_stream;
+
+// output is handed to the sink write_size bytes at a time, which for an
+// fd sink is one write(2) each
+#define DEFAULT_WRITE_SIZE 1048576
+#define MIN_WRITE_SIZE 4096
+#define MAX_WRITE_SIZE 1073741824
+
+// dynamic blocks by the width of their literal/length table, with the
+// time spent creating their tables and decoding them
+struct table_stats {
+    uint64_t blocks[MAX_LL_PRIMARY_BITS + 1];
+    uint64_t output[MAX_LL_PRIMARY_BITS + 1];
+    uint64_t create_ns[MAX_LL_PRIMARY_BITS + 1];
+    uint64_t decode_ns[MAX_LL_PRIMARY_BITS + 1];
+};
+
+struct decompress_options {
+    bool crc_thread;  // compute CRC32 on a separate thread for large members
+    unsigned threads; // decompress members on this many threads if above 1
+    struct gzip_index *index; // record checkpoints in index, on one thread
+    size_t write_size; // between MIN_WRITE_SIZE and MAX_WRITE_SIZE
+    struct table_stats *stats; // time dynamic blocks in stats, on one thread
+};
+
+// fields of a member header, extra points into the input buffer
+// ref: https://www.rfc-editor.org/rfc/rfc1952.txt section 2.3.1
+struct member_header {
+    uint8_t FLG;
+    uint32_t MTIME;
+    uint8_t XFL;
+    uint8_t OS;
+    uint8_t *extra; // FEXTRA field, NULL if not present
+    uint16_t XLEN;
+};
+
+// parses the member header starting at *buf_pos and sets *buf_pos to
+// the position of the compressed blocks
+bool check_member_header(uint8_t *buf, size_t buf_len, size_t *buf_pos,
+                         struct member_header *header);
+bool find_extra_subfield(struct member_header *header, uint8_t SI1, uint8_t SI2,
+                         uint8_t **data, uint16_t *len);
+
+// decompresses deflate blocks starting at bit offset *bit_pos of buf, window
+// holds the window_len bytes of output preceding them. Stops after the final
+// block, setting *final, or before the first block starting at or after
+// stop_bit. *bit_pos is set to where decoding stopped, crc and size are of
+// the output written to sink
+bool decompress_blocks_at(uint8_t *buf, size_t buf_len, uint64_t *bit_pos,
+                          uint64_t stop_bit, const uint8_t *window,
+                          size_t window_len, struct sink *sink, bool *final,
+                          uint32_t *crc, uint64_t *size);
+
+// decompresses deflate blocks starting at bit offset bit_pos of buf like
+// decompress_blocks_at, but writes only len bytes of output after the first
+// skip bytes to sink. Stops after the final block or once the len bytes are
+// written, *written is set to the bytes written to sink
+bool extract_blocks_at(uint8_t *buf, size_t buf_len, uint64_t bit_pos,
+                       const uint8_t *window, size_t window_len, uint64_t skip,
+                       uint64_t len, struct sink *sink, uint64_t *written);
+
+// ISIZE of the last member trailer, which is the output size of a
+// single member file smaller than 4GiB. Returns false if it can't be
+bool output_size_hint(uint8_t *buf, size_t buf_len, uint64_t *size);
+
+// decompresses the member starting at *buf_pos and sets *buf_pos to
+// the position after its trailer
+bool decompress_member(uint8_t *buf, size_t buf_len, size_t *buf_pos,
+                       struct sink *sink, struct decompress_options *options);
+bool decompress_members(uint8_t *buf, size_t buf_len, struct sink *sink,
+                        struct decompress_options *options);
+
+// decompresses the members of s as its input is read, on one thread and
+// without an index
+bool decompress_stream(struct input_stream *s, struct sink *sink,
+                       struct decompress_options *options);
 
 #endif
@@ -0,0 +1,471 @@
+#include "deflate.h"
+#include "huffman_table.h"
+#include "bit_reader.h"
+#include "log.h"
+
+#include <string.h>
+#include <inttypes.h>
+#include <stdbool.h>
+
+// {length, extra_bits} for length codes 257 to 285
+// ref: https://www.ietf.org/rfc/rfc1951.txt section 3.2.5
+const struct value_and_bits length_data[29] = {{3, 0}, {4, 0}, {5, 0}, {6, 0},
+                                               {7, 0}, {8, 0}, {9, 0}, {10, 0},
+                                               {11, 1}, {13, 1}, {15, 1},
+                                               {17, 1}, {19, 2}, {23, 2},
+                                               {27, 2}, {31, 2}, {35, 3},
+                                               {43, 3}, {51, 3}, {59, 3},
+                                               {67, 4}, {83, 4}, {99, 4},
+                                               {115, 4}, {131, 5}, {163, 5},
+                                               {195, 5}, {227, 5}, {258, 0}};
+
+
+// {distance, extra_bits} for distance codes 0 to 29
+// ref: https://www.ietf.org/rfc/rfc1951.txt section 3.2.5
+const struct value_and_bits dist_data[30] = {{1, 0}, {2, 0}, {3, 0}, {4, 0},
+                                             {5, 1}, {7, 1}, {9, 2}, {13, 2},
+                                             {17, 3}, {25, 3}, {33, 4}, {49, 4},
+                                             {65, 5}, {97, 5}, {129, 6},
+                                             {193, 6}, {257, 7}, {385, 7},
+                                             {513, 8}, {769, 8}, {1025, 9},
+                                             {1537, 9}, {2049, 10}, {3073, 10},
+                                             {4097, 11}, {6145, 11}, {8193, 12},
+                                             {12289, 12}, {16385, 13},
+                                             {24577, 13}};
+
+// the value entries of the decoders writing bytes. Length code 284 with
+// extra bits 31 isn't resolved to 258 so that they can reject it
+static const struct huffman_values length_values = {257, 29, length_data,
+                                                    257};
+static const struct huffman_values distance_values = {0, 30, dist_data,
+                                                      32768};
+
+// bits in order from lsb to msb
+bool read_bits(struct bit_reader *in, uint8_t bits, uint16_t *bits_value)
+{
+    refill_bits(in);
+    uint16_t tmp = (uint16_t) take_bits(in, bits);
+    if (bit_reader_overrun(in)) {
+        log_error("Unexpected buffer length\n");
+        return false;
+    }
+
+    *bits_value = tmp;
+
+    return true;
+}
+
+// extra bits need to be loaded in the bit buffer already
+bool length_from_length_code(struct bit_reader *in, uint16_t code,
+                             uint16_t *length)
+{
+    if (!is_length_code(code)) {
+        log_error("Expecting valid length code\n");
+        return false;
+    }
+
+    uint16_t length_start = length_data[code - 257].value;
+    uint8_t extra_bits = length_data[code - 257].extra_bits;
+    uint16_t extra_bits_value = (uint16_t) take_bits(in, extra_bits);
+
+    // for byte 284 extra bits of length 5 don't use the last possible
+    // value 31 (11111) which would make the length 227 + 31 = 258.
+    // 258 has separate length code 285
+    if (code == 284 && extra_bits_value == 31) {
+        log_error("Unexpected length extra value 31 for code 284\n");
+        return false;
+    }
+
+    uint16_t len = length_start + extra_bits_value;
+    if (len > 258 || len < 3) {
+        log_error("Expecting length to be between 3 and 258\n");
+        return false;
+    }
+
+    *length = len;
+    return true;
+}
+
+// extra bits need to be loaded in the bit buffer already
+bool distance_from_distance_code(struct bit_reader *in, uint8_t code,
+                                 uint16_t *distance)
+{
+    if (!is_distance_code(code)) {
+        log_error("Expecting valid distance code\n");
+        return false;
+    }
+
+    uint16_t distance_start = dist_data[code].value;
+    uint8_t extra_bits = dist_data[code].extra_bits;
+    uint16_t extra_bits_value = (uint16_t) take_bits(in, extra_bits);
+
+    uint16_t dist = distance_start + extra_bits_value;
+    if (dist < 1 || dist > 32768) {
+        log_error("Expecting distance to be between 1 and 32768\n");
+        return false;
+    }
+
+    *distance = dist;
+    return true;
+}
+
+bool create_fixed_tables(bool values, struct huffman_table *ll_table,
+                         struct huffman_entry *ll_entries,
+                         struct huffman_table *d_table,
+                         struct huffman_entry *d_entries)
+{
+    uint8_t lengths[288];
+
+    // fixed huffman code lengths for block type 01
+    // ref: https://www.ietf.org/rfc/rfc1951.txt section 3.2.6
+    for (uint8_t i = 0; i < 144; ++i)
+        lengths[i] = 8;
+    for (uint16_t i = 144; i < 256; ++i)
+        lengths[i] = 9;
+    for (uint16_t i = 256; i < 280; ++i)
+        lengths[i] = 7;
+    for (uint16_t i = 280; i <= 287; ++i)
+        lengths[i] = 8;
+
+    bool success = create_huffman_value_table(lengths, 288, 15,
+                                              LL_PRIMARY_BITS,
+                                              values ? &length_values : NULL,
+                                              ll_entries, LL_TABLE_ENTRIES,
+                                              ll_table);
+    if (!success) {
+        log_error("Failed to create huffman table in block type 01\n");
+        return false;
+    }
+
+    // fixed distance codes are 5 bits long, distance codes 30 and 31
+    // never occur in the compressed data
+    uint8_t d_lengths[30];
+    for (uint8_t i = 0; i < 30; ++i)
+        d_lengths[i] = 5;
+
+    success = create_huffman_value_table(d_lengths, 30, 15, D_PRIMARY_BITS,
+                                         values ? &distance_values : NULL,
+                                         d_entries, D_TABLE_ENTRIES, d_table);
+    if (!success) {
+        log_error("Failed to create distance huffman table in "
+                  "block type 01\n");
+        return false;
+    }
+
+    return true;
+}
+
+// reads the code lengths following a block type 10 header and creates
+// the literal/length and distance tables from them
+// ref: https://www.rfc-editor.org/rfc/rfc1951.txt section 3.2.7
+bool read_dynamic_tables(struct bit_reader *in, uint64_t expected_size,
+                         bool values, struct huffman_table *ll_table,
+                         struct huffman_entry *ll_entries,
+                         struct huffman_table *d_table,
+                         struct huffman_entry *d_entries)
+{
+    uint16_t tmp = 0;
+
+    // HLIT 5 bits, HDIST 5 bits, HCLEN 4 bits
+    // ref: https://www.ietf.org/rfc/rfc1951.txt section 3.2.7
+
+    // HLIT
+    bool success = read_bits(in, 5, &tmp);
+    if (!success) {
+        log_error("Failed to read HLIT in block type 10\n");
+        return false;
+    }
+    uint8_t HLIT = (uint8_t) tmp;
+    // number of literal length codes
+    uint16_t ll_code_cnt = (uint16_t) HLIT + 257;
+    if (ll_code_cnt < 257 || ll_code_cnt > 286) {
+        log_error("Expecting ll code count to be between 257 to 285 "
+                  " in block type 10\n");
+        return false;
+    }
+
+    // HDIST
+    success = read_bits(in, 5, &tmp);
+    if (!success) {
+        log_error("Failed to read HDIST in block type 10\n");
+        return false;
+    }
+    uint8_t HDIST = (uint8_t) tmp;
+    // number of distance codes
+    uint8_t d_code_cnt = HDIST + 1;
+    if (d_code_cnt < 1 || d_code_cnt > 32) {
+        log_error("Expecting distance code count to be between "
+                  "1 to 31 in block type 10\n");
+        return false;
+    }
+
+    // HCLEN
+    success = read_bits(in, 4, &tmp);
+    if (!success) {
+        log_error("Failed to read HCLEN in block type 10\n");
+        return false;
+    }
+    uint8_t HCLEN = (uint8_t) tmp;
+    // number of code length codes
+    uint8_t cl_code_cnt = HCLEN + 4;
+    if (cl_code_cnt < 4 || cl_code_cnt > 19) {
+        log_error("Expecting cl code count to be between "
+                  "4 and 18 in block type 10\n");
+        return false;
+    }
+
+    // ref: https://www.rfc-editor.org/rfc/rfc1951.txt section 3.2.7
+    uint8_t cl_code_serial[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12,
+                                  3, 13, 2, 14, 1, 15};
+    uint8_t cl_code_lengths[19];
+    for (uint8_t i = 0; i < 19; ++i)
+        cl_code_lengths[i] = 0;
+
+    for (uint8_t i = 0; i < cl_code_cnt; ++i) {
+        // cl code lengths are 3 bits each
+        success = read_bits(in, 3, &tmp);
+        if (!success) {
+            log_error("Failed to read code length code in "
+                      "block type 10\n");
+            return false;
+        }
+        cl_code_lengths[cl_code_serial[i]] = (uint8_t) tmp;
+    }
+
+    struct huffman_table cl_table;
+    struct huffman_entry cl_entries[CL_TABLE_ENTRIES];
+    success = create_huffman_table(cl_code_lengths, 19, 7, CL_PRIMARY_BITS,
+                                   cl_entries, CL_TABLE_ENTRIES, &cl_table);
+    if (!success) {
+        log_error("Failed to create code length huffman table for "
+                  "block type 10\n");
+        return false;
+    }
+
+    uint8_t ll_code_lengths[286];
+    for (uint16_t i = 0; i < 286; ++i)
+        ll_code_lengths[i] = 0;
+
+    uint8_t d_code_lengths[32];
+    for (uint8_t i = 0; i < 32; ++i)
+        d_code_lengths[i] = 0;
+
+    // The code length repeat codes can cross from HLIT + 257 to the
+    // HDIST + 1 code lengths.  In other words, all code lengths form
+    // a single sequence of HLIT + HDIST + 258 values.
+    // ref: https://www.rfc-editor.org/rfc/rfc1951.txt section 3.2.7
+
+    uint8_t previous_code_length = 0;
+    uint16_t total = ll_code_cnt + d_code_cnt;
+    uint16_t cnt = 0;
+
+    while (cnt < total) {
+        uint16_t symbol = 0;
+        refill_bits(in);
+        success = decode_symbol(in, &cl_table, &symbol);
+        if (!success || bit_reader_overrun(in)) {
+            log_error("Could not find huffman code in block type 10\n");
+            return false;
+        }
+        if (!is_code_length_code(symbol)) {
+            log_error("Invalid code length code found in "
+                      "block type 10\n");
+            return false;
+        }
+
+        uint8_t code = (uint8_t) symbol;
+        if (code == 16 && cnt == 0) {
+            log_error("Repeat code 16 without any previous "
+                      "code length in block type 10\n");
+            return false;
+        }
+
+        if (code >= 0 && code <= 15) {
+            if (cnt < ll_code_cnt) {
+                ll_code_lengths[cnt] = code;
+            } else {
+                d_code_lengths[cnt - ll_code_cnt] = code;
+            }
+            previous_code_length = code;
+            cnt++;
+        } else if (code == 16) {
+            // extra 2 bits for repeat code 16
+            // 0 = 3, ... , 3 = 6
+            success = read_bits(in, 2, &tmp);
+            if (!success) {
+                log_error("Failed to read extra 2 bits for "
+                          "code length 16 in block type 10\n");
+                return false;
+            }
+            tmp += 3;
+            while (tmp--) {
+                if (cnt >= total) {
+                    log_error("Repeat code exceeds HLIT + HDIST + 258 "
+                              "values in block type 10\n");
+                    return false;
+                }
+                if (cnt < ll_code_cnt) {
+                    ll_code_lengths[cnt] = previous_code_length;
+                } else {
+                    d_code_lengths[cnt - ll_code_cnt] = previous_code_length;
+                }
+                cnt++;
+            }
+        } else if (code == 17 || code == 18) {
+            // copy zero 3 - 10 times (byte == 17)
+            // copy zero 11 - 138 times (byte == 18)
+            uint8_t extra_bits = code == 17 ? 3 : 7;
+            uint8_t plus = code == 17 ? 3 : 11;
+            success = read_bits(in, extra_bits, &tmp);
+            if (!success) {
+                log_error("Failed to read extra bits for repeat code %d "
+                          "in block type 10\n", code);
+                return false;
+            }
+            previous_code_length = 0;
+            tmp += plus;
+            while (tmp--) {
+                if (cnt >= total) {
+                    log_error("Repeat code exceeds HLIT + HDIST + 258 "
+                              "values in block type 10\n");
+                    return false;
+                }
+                if (cnt < ll_code_cnt) {
+                    ll_code_lengths[cnt] = 0;
+                } else {
+                    d_code_lengths[cnt - ll_code_cnt] = 0;
+                }
+                cnt++;
+            }
+        }
+    }
+
+    uint8_t ll_primary_bits = LL_PRIMARY_BITS;
+    if (expected_size > 0)
+        ll_primary_bits = choose_ll_primary_bits(ll_code_lengths,
+                                                 ll_code_cnt, expected_size);
+    success = create_huffman_value_table(ll_code_lengths, ll_code_cnt, 15,
+                                         ll_primary_bits,
+                                         values ? &length_values : NULL,
+                                         ll_entries,
+                                         MAX_TABLE_ENTRIES(286,
+                                                           ll_primary_bits),
+                                         ll_table);
+    if (!success) {
+        log_error("Failed to create huffman table for ll codes in "
+                  "block type 10\n");
+        return false;
+    }
+
+    success = create_huffman_value_table(d_code_lengths, d_code_cnt, 15,
+                                         D_PRIMARY_BITS,
+                                         values ? &distance_values : NULL,
+                                         d_entries, D_TABLE_ENTRIES, d_table);
+    if (!success) {
+        log_error("Failed to create huffman table for distance codes "
+                  "in block type 10\n");
+        return false;
+    }
+
+    return true;
+}
+
+// estimates in ns of creating a primary table entry, of adding literal
+// pairs to one, and of what a sub-table lookup costs and a literal pair
+// saves while decoding, from the times ungzip -t shows
+#define ENTRY_NS 1.5
+#define PAIR_ENTRY_NS 3.0
+#define SUB_TABLE_NS 4.0
+#define PAIR_NS 8.0
+
+uint8_t choose_ll_primary_bits(const uint8_t *code_lengths, uint16_t length,
+                               uint64_t expected_size)
+{
+    // a code of len bits is used for about 1 in 2^len symbols, weights
+    // are in 1/32768ths of them. Neighbouring literals often have codes
+    // of the same length, counting them in two arrays keeps the
+    // increments of one count apart
+    uint16_t cnt[2][16] = {{0}};
+    for (uint16_t i = 0; i < 256; i += 2) {
+        cnt[0][code_lengths[i]]++;
+        cnt[1][code_lengths[i + 1]]++;
+    }
+
+    uint32_t literals[16] = {0};
+    uint32_t shorter_literals[16] = {0};
+    for (uint8_t len = 1; len <= 15; ++len) {
+        literals[len] = (uint32_t) (cnt[0][len] + cnt[1][len]) << (15 - len);
+        shorter_literals[len] = shorter_literals[len - 1] + literals[len];
+    }
+
+    // literals make one byte of output and lengths half way into their
+    // range, output is in halves of bytes
+    uint32_t weights[16];
+    memcpy(weights, literals, sizeof(weights));
+    uint64_t output = 2 * (uint64_t) shorter_literals[15];
+    for (uint16_t i = 257; i < length; ++i) {
+        uint8_t len = code_lengths[i];
+        if (len == 0)
+            continue;
+
+        uint32_t weight = 1u << (15 - len);
+        weights[len] += weight;
+        if (is_length_code(i)) {
+            const struct value_and_bits *ld = &length_data[i - 257];
+            output += weight * (2u * ld->value + (1u << ld->extra_bits) - 1);
+        }
+    }
+    if (output == 0)
+        return LL_PRIMARY_BITS;
+    double symbols = (double) expected_size * 2 * 32768 / output;
+
+    // wider tables save the sub-table lookups of codes up to their width
+    // and decode two literals at once when both codes fit, the width
+    // saving the most time after creating the table is taken
+    uint8_t best = LL_PRIMARY_BITS;
+    double best_saved = 0;
+    uint32_t sub_table = 0;
+    for (uint8_t bits = LL_PRIMARY_BITS + 1; bits <= MAX_LL_PRIMARY_BITS;
+         ++bits) {
+        sub_table += weights[bits];
+        uint64_t pairs = 0;
+        for (uint8_t len = 1; len < bits; ++len)
+            pairs += (uint64_t) literals[len] * shorter_literals[bits - len];
+
+        double saved = symbols * (SUB_TABLE_NS / 32768 * sub_table +
+                                  PAIR_NS / 32768 / 32768 * pairs) -
+            ((1u << bits) - (1u << LL_PRIMARY_BITS)) * ENTRY_NS -
+            (1u << bits) * PAIR_ENTRY_NS;
+        if (saved > best_saved) {
+            best = bits;
+            best_saved = saved;
+        }
+    }
+
+    return best;
+}
+
+void add_literal_pairs(struct huffman_entry *entries, uint8_t primary_bits)
+{
+    // the second code of an entry is looked up at a lower index, which
+    // is still unchanged going down from the top
+    for (uint32_t i = 1u << primary_bits; i-- > 0;) {
+        struct huffman_entry *first = &entries[i];
+        if (first->sub_bits || !is_literal_code(first->symbol) ||
+            first->len == 0 || first->len >= primary_bits)
+            continue;
+
+        // the bits above the index are zero, so the second code is only
+        // the right one if it ends within the primary bits as well
+        const struct huffman_entry *second = &entries[i >> first->len];
+        if (second->sub_bits || !is_literal_code(second->symbol) ||
+            second->len == 0 || first->len + second->len > primary_bits)
+            continue;
+
+        first->symbol = (uint16_t) (first->symbol | second->symbol << 8);
+        first->len = (uint8_t) (first->len + second->len);
+        first->sub_bits = LITERAL_PAIR;
+    }
+
+    return;
+}
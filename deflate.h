@@ -0,0 +1,161 @@
+#ifndef DEFLATE
+#define DEFLATE
+
+#include "bit_reader.h"
+#include "huffman_table.h"
+#include "log.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+// pieces of the deflate format shared by the decoders writing bytes and
+// the speculative decoder writing symbols of unknown window bytes
+// ref: https://www.rfc-editor.org/rfc/rfc1951.txt
+
+#define MAX_DISTANCE 32768
+
+// bits indexing the primary decoding tables, longer codes continue
+// in sub-tables
+#define LL_PRIMARY_BITS 9
+#define D_PRIMARY_BITS 6
+#define CL_PRIMARY_BITS 7
+
+// entries the tables of complete codes take at most. A code with k more
+// bits than the primary ones shares its slot with at least k others, so
+// the codes longer than the primary bits fill no more than codes / (k + 1)
+// of the largest sub-tables. Code length codes are at most 7 bits long
+#define MAX_TABLE_ENTRIES(codes, primary_bits) \
+    ((1 << (primary_bits)) + ((codes) + 15 - (primary_bits)) / \
+     (16 - (primary_bits)) * (1 << (15 - (primary_bits))))
+#define LL_TABLE_ENTRIES MAX_TABLE_ENTRIES(286, LL_PRIMARY_BITS)
+#define D_TABLE_ENTRIES MAX_TABLE_ENTRIES(32, D_PRIMARY_BITS)
+#define CL_TABLE_ENTRIES (1 << CL_PRIMARY_BITS)
+
+// the literal/length tables of dynamic blocks decoded into bytes may
+// have wider primary tables, chosen for each block by
+// choose_ll_primary_bits, in which two literals whose codes fit in the
+// primary bits together share one entry
+#define MAX_LL_PRIMARY_BITS 12
+#define MAX_LL_TABLE_ENTRIES MAX_TABLE_ENTRIES(286, MAX_LL_PRIMARY_BITS)
+
+// sub_bits of an entry holding two literals, the first one in the low
+// byte of symbol and the bits of both codes in len. Only the decoders
+// that check for it can use tables with such entries
+#define LITERAL_PAIR 0xff
+
+extern const struct value_and_bits length_data[29];
+extern const struct value_and_bits dist_data[30];
+
+static inline bool is_length_code(int16_t code)
+{
+    return code >= 257 && code <= 285;
+}
+
+static inline bool is_literal_code(int16_t code)
+{
+    return code >= 0 && code <= 255;
+}
+
+static inline bool is_literal_length_code(int16_t code)
+{
+    return code >= 0 && code <= 285;
+}
+
+static inline bool is_distance_code(int16_t code)
+{
+    return code >= 0 && code <= 29;
+}
+
+static inline bool is_code_length_code(int16_t code)
+{
+    return code >= 0 && code <= 18;
+}
+
+static inline bool is_link(const struct huffman_entry *entry)
+{
+    return entry->sub_bits != 0 && entry->sub_bits < VALUE_EXTRA;
+}
+
+// value of a length or distance entry whose extra bits are loaded in
+// the bit buffer
+static inline uint16_t take_value(struct bit_reader *in,
+                                  const struct huffman_entry *entry)
+{
+    return (uint16_t) (entry->symbol +
+                       take_bits(in, entry->sub_bits - VALUE_EXTRA));
+}
+
+static inline const struct huffman_entry *
+lookup_entry(const struct huffman_table *table, uint64_t bits)
+{
+    const struct huffman_entry *entry =
+        &table->entries[bits & ((1u << table->primary_bits) - 1)];
+    if (is_link(entry)) {
+        uint32_t index = (bits >> table->primary_bits) &
+            ((1u << entry->sub_bits) - 1);
+        entry = &table->entries[entry->symbol + index];
+    }
+
+    return entry;
+}
+
+// the bit buffer needs to hold at least 15 bits, the longest code
+static inline bool decode_symbol(struct bit_reader *in,
+                                 const struct huffman_table *table,
+                                 uint16_t *symbol)
+{
+    const struct huffman_entry *entry = lookup_entry(table, peek_bits(in));
+    if (entry->len == 0) {
+        log_error("Invalid huffman code\n");
+        return false;
+    }
+
+    consume_bits(in, entry->len);
+    *symbol = entry->symbol;
+    return true;
+}
+
+bool read_bits(struct bit_reader *in, uint8_t bits, uint16_t *bits_value);
+bool length_from_length_code(struct bit_reader *in, uint16_t code,
+                             uint16_t *length);
+bool distance_from_distance_code(struct bit_reader *in, uint8_t code,
+                                 uint16_t *distance);
+// tables of the fixed codes of block type 01. gen_fixed_tables writes
+// them out with create_fixed_tables at build time, so that decoding a
+// fixed block doesn't have to create them and all blocks share them
+extern const struct huffman_table fixed_ll_table;
+extern const struct huffman_table fixed_d_table;
+// the same with value entries for the length and distance codes
+extern const struct huffman_table fixed_ll_value_table;
+extern const struct huffman_table fixed_d_value_table;
+
+// the tables are built in ll_entries and d_entries, which have room for
+// LL_TABLE_ENTRIES and D_TABLE_ENTRIES. With values the length and
+// distance codes get value entries
+bool create_fixed_tables(bool values, struct huffman_table *ll_table,
+                         struct huffman_entry *ll_entries,
+                         struct huffman_table *d_table,
+                         struct huffman_entry *d_entries);
+// the literal/length table of a block expected to have expected_size
+// bytes of output gets the primary bits choose_ll_primary_bits picks and
+// ll_entries has room for MAX_LL_TABLE_ENTRIES, if expected_size is 0 it
+// gets LL_PRIMARY_BITS and LL_TABLE_ENTRIES are enough
+bool read_dynamic_tables(struct bit_reader *in, uint64_t expected_size,
+                         bool values, struct huffman_table *ll_table,
+                         struct huffman_entry *ll_entries,
+                         struct huffman_table *d_table,
+                         struct huffman_entry *d_entries);
+
+// primary bits between LL_PRIMARY_BITS and MAX_LL_PRIMARY_BITS of the
+// literal/length table with the given code lengths. Wider tables take
+// longer to create but less time to decode with, fewer of the codes are
+// in sub-tables and more literal pairs fit. The code lengths tell how
+// often the codes are used and what the output of a symbol is on average
+uint8_t choose_ll_primary_bits(const uint8_t *code_lengths, uint16_t length,
+                               uint64_t expected_size);
+
+// turns the primary entries of literal/length table whose bits start
+// with two literal codes into LITERAL_PAIR entries
+void add_literal_pairs(struct huffman_entry *entries, uint8_t primary_bits);
+
+#endif
@@ -0,0 +1,312 @@
+// generated by gen_fixed_tables, do not edit
+
+#include "deflate.h"
+#include "huffman_table.h"
+
+static const struct huffman_entry fixed_ll_table_entries[512] = {
+    {256, 7, 0}, {80, 8, 0}, {16, 8, 0}, {280, 8, 0},
+    {272, 7, 0}, {112, 8, 0}, {48, 8, 0}, {192, 9, 0},
+    {264, 7, 0}, {96, 8, 0}, {32, 8, 0}, {160, 9, 0},
+    {0, 8, 0}, {128, 8, 0}, {64, 8, 0}, {224, 9, 0},
+    {260, 7, 0}, {88, 8, 0}, {24, 8, 0}, {144, 9, 0},
+    {276, 7, 0}, {120, 8, 0}, {56, 8, 0}, {208, 9, 0},
+    {268, 7, 0}, {104, 8, 0}, {40, 8, 0}, {176, 9, 0},
+    {8, 8, 0}, {136, 8, 0}, {72, 8, 0}, {240, 9, 0},
+    {258, 7, 0}, {84, 8, 0}, {20, 8, 0}, {284, 8, 0},
+    {274, 7, 0}, {116, 8, 0}, {52, 8, 0}, {200, 9, 0},
+    {266, 7, 0}, {100, 8, 0}, {36, 8, 0}, {168, 9, 0},
+    {4, 8, 0}, {132, 8, 0}, {68, 8, 0}, {232, 9, 0},
+    {262, 7, 0}, {92, 8, 0}, {28, 8, 0}, {152, 9, 0},
+    {278, 7, 0}, {124, 8, 0}, {60, 8, 0}, {216, 9, 0},
+    {270, 7, 0}, {108, 8, 0}, {44, 8, 0}, {184, 9, 0},
+    {12, 8, 0}, {140, 8, 0}, {76, 8, 0}, {248, 9, 0},
+    {257, 7, 0}, {82, 8, 0}, {18, 8, 0}, {282, 8, 0},
+    {273, 7, 0}, {114, 8, 0}, {50, 8, 0}, {196, 9, 0},
+    {265, 7, 0}, {98, 8, 0}, {34, 8, 0}, {164, 9, 0},
+    {2, 8, 0}, {130, 8, 0}, {66, 8, 0}, {228, 9, 0},
+    {261, 7, 0}, {90, 8, 0}, {26, 8, 0}, {148, 9, 0},
+    {277, 7, 0}, {122, 8, 0}, {58, 8, 0}, {212, 9, 0},
+    {269, 7, 0}, {106, 8, 0}, {42, 8, 0}, {180, 9, 0},
+    {10, 8, 0}, {138, 8, 0}, {74, 8, 0}, {244, 9, 0},
+    {259, 7, 0}, {86, 8, 0}, {22, 8, 0}, {286, 8, 0},
+    {275, 7, 0}, {118, 8, 0}, {54, 8, 0}, {204, 9, 0},
+    {267, 7, 0}, {102, 8, 0}, {38, 8, 0}, {172, 9, 0},
+    {6, 8, 0}, {134, 8, 0}, {70, 8, 0}, {236, 9, 0},
+    {263, 7, 0}, {94, 8, 0}, {30, 8, 0}, {156, 9, 0},
+    {279, 7, 0}, {126, 8, 0}, {62, 8, 0}, {220, 9, 0},
+    {271, 7, 0}, {110, 8, 0}, {46, 8, 0}, {188, 9, 0},
+    {14, 8, 0}, {142, 8, 0}, {78, 8, 0}, {252, 9, 0},
+    {256, 7, 0}, {81, 8, 0}, {17, 8, 0}, {281, 8, 0},
+    {272, 7, 0}, {113, 8, 0}, {49, 8, 0}, {194, 9, 0},
+    {264, 7, 0}, {97, 8, 0}, {33, 8, 0}, {162, 9, 0},
+    {1, 8, 0}, {129, 8, 0}, {65, 8, 0}, {226, 9, 0},
+    {260, 7, 0}, {89, 8, 0}, {25, 8, 0}, {146, 9, 0},
+    {276, 7, 0}, {121, 8, 0}, {57, 8, 0}, {210, 9, 0},
+    {268, 7, 0}, {105, 8, 0}, {41, 8, 0}, {178, 9, 0},
+    {9, 8, 0}, {137, 8, 0}, {73, 8, 0}, {242, 9, 0},
+    {258, 7, 0}, {85, 8, 0}, {21, 8, 0}, {285, 8, 0},
+    {274, 7, 0}, {117, 8, 0}, {53, 8, 0}, {202, 9, 0},
+    {266, 7, 0}, {101, 8, 0}, {37, 8, 0}, {170, 9, 0},
+    {5, 8, 0}, {133, 8, 0}, {69, 8, 0}, {234, 9, 0},
+    {262, 7, 0}, {93, 8, 0}, {29, 8, 0}, {154, 9, 0},
+    {278, 7, 0}, {125, 8, 0}, {61, 8, 0}, {218, 9, 0},
+    {270, 7, 0}, {109, 8, 0}, {45, 8, 0}, {186, 9, 0},
+    {13, 8, 0}, {141, 8, 0}, {77, 8, 0}, {250, 9, 0},
+    {257, 7, 0}, {83, 8, 0}, {19, 8, 0}, {283, 8, 0},
+    {273, 7, 0}, {115, 8, 0}, {51, 8, 0}, {198, 9, 0},
+    {265, 7, 0}, {99, 8, 0}, {35, 8, 0}, {166, 9, 0},
+    {3, 8, 0}, {131, 8, 0}, {67, 8, 0}, {230, 9, 0},
+    {261, 7, 0}, {91, 8, 0}, {27, 8, 0}, {150, 9, 0},
+    {277, 7, 0}, {123, 8, 0}, {59, 8, 0}, {214, 9, 0},
+    {269, 7, 0}, {107, 8, 0}, {43, 8, 0}, {182, 9, 0},
+    {11, 8, 0}, {139, 8, 0}, {75, 8, 0}, {246, 9, 0},
+    {259, 7, 0}, {87, 8, 0}, {23, 8, 0}, {287, 8, 0},
+    {275, 7, 0}, {119, 8, 0}, {55, 8, 0}, {206, 9, 0},
+    {267, 7, 0}, {103, 8, 0}, {39, 8, 0}, {174, 9, 0},
+    {7, 8, 0}, {135, 8, 0}, {71, 8, 0}, {238, 9, 0},
+    {263, 7, 0}, {95, 8, 0}, {31, 8, 0}, {158, 9, 0},
+    {279, 7, 0}, {127, 8, 0}, {63, 8, 0}, {222, 9, 0},
+    {271, 7, 0}, {111, 8, 0}, {47, 8, 0}, {190, 9, 0},
+    {15, 8, 0}, {143, 8, 0}, {79, 8, 0}, {254, 9, 0},
+    {256, 7, 0}, {80, 8, 0}, {16, 8, 0}, {280, 8, 0},
+    {272, 7, 0}, {112, 8, 0}, {48, 8, 0}, {193, 9, 0},
+    {264, 7, 0}, {96, 8, 0}, {32, 8, 0}, {161, 9, 0},
+    {0, 8, 0}, {128, 8, 0}, {64, 8, 0}, {225, 9, 0},
+    {260, 7, 0}, {88, 8, 0}, {24, 8, 0}, {145, 9, 0},
+    {276, 7, 0}, {120, 8, 0}, {56, 8, 0}, {209, 9, 0},
+    {268, 7, 0}, {104, 8, 0}, {40, 8, 0}, {177, 9, 0},
+    {8, 8, 0}, {136, 8, 0}, {72, 8, 0}, {241, 9, 0},
+    {258, 7, 0}, {84, 8, 0}, {20, 8, 0}, {284, 8, 0},
+    {274, 7, 0}, {116, 8, 0}, {52, 8, 0}, {201, 9, 0},
+    {266, 7, 0}, {100, 8, 0}, {36, 8, 0}, {169, 9, 0},
+    {4, 8, 0}, {132, 8, 0}, {68, 8, 0}, {233, 9, 0},
+    {262, 7, 0}, {92, 8, 0}, {28, 8, 0}, {153, 9, 0},
+    {278, 7, 0}, {124, 8, 0}, {60, 8, 0}, {217, 9, 0},
+    {270, 7, 0}, {108, 8, 0}, {44, 8, 0}, {185, 9, 0},
+    {12, 8, 0}, {140, 8, 0}, {76, 8, 0}, {249, 9, 0},
+    {257, 7, 0}, {82, 8, 0}, {18, 8, 0}, {282, 8, 0},
+    {273, 7, 0}, {114, 8, 0}, {50, 8, 0}, {197, 9, 0},
+    {265, 7, 0}, {98, 8, 0}, {34, 8, 0}, {165, 9, 0},
+    {2, 8, 0}, {130, 8, 0}, {66, 8, 0}, {229, 9, 0},
+    {261, 7, 0}, {90, 8, 0}, {26, 8, 0}, {149, 9, 0},
+    {277, 7, 0}, {122, 8, 0}, {58, 8, 0}, {213, 9, 0},
+    {269, 7, 0}, {106, 8, 0}, {42, 8, 0}, {181, 9, 0},
+    {10, 8, 0}, {138, 8, 0}, {74, 8, 0}, {245, 9, 0},
+    {259, 7, 0}, {86, 8, 0}, {22, 8, 0}, {286, 8, 0},
+    {275, 7, 0}, {118, 8, 0}, {54, 8, 0}, {205, 9, 0},
+    {267, 7, 0}, {102, 8, 0}, {38, 8, 0}, {173, 9, 0},
+    {6, 8, 0}, {134, 8, 0}, {70, 8, 0}, {237, 9, 0},
+    {263, 7, 0}, {94, 8, 0}, {30, 8, 0}, {157, 9, 0},
+    {279, 7, 0}, {126, 8, 0}, {62, 8, 0}, {221, 9, 0},
+    {271, 7, 0}, {110, 8, 0}, {46, 8, 0}, {189, 9, 0},
+    {14, 8, 0}, {142, 8, 0}, {78, 8, 0}, {253, 9, 0},
+    {256, 7, 0}, {81, 8, 0}, {17, 8, 0}, {281, 8, 0},
+    {272, 7, 0}, {113, 8, 0}, {49, 8, 0}, {195, 9, 0},
+    {264, 7, 0}, {97, 8, 0}, {33, 8, 0}, {163, 9, 0},
+    {1, 8, 0}, {129, 8, 0}, {65, 8, 0}, {227, 9, 0},
+    {260, 7, 0}, {89, 8, 0}, {25, 8, 0}, {147, 9, 0},
+    {276, 7, 0}, {121, 8, 0}, {57, 8, 0}, {211, 9, 0},
+    {268, 7, 0}, {105, 8, 0}, {41, 8, 0}, {179, 9, 0},
+    {9, 8, 0}, {137, 8, 0}, {73, 8, 0}, {243, 9, 0},
+    {258, 7, 0}, {85, 8, 0}, {21, 8, 0}, {285, 8, 0},
+    {274, 7, 0}, {117, 8, 0}, {53, 8, 0}, {203, 9, 0},
+    {266, 7, 0}, {101, 8, 0}, {37, 8, 0}, {171, 9, 0},
+    {5, 8, 0}, {133, 8, 0}, {69, 8, 0}, {235, 9, 0},
+    {262, 7, 0}, {93, 8, 0}, {29, 8, 0}, {155, 9, 0},
+    {278, 7, 0}, {125, 8, 0}, {61, 8, 0}, {219, 9, 0},
+    {270, 7, 0}, {109, 8, 0}, {45, 8, 0}, {187, 9, 0},
+    {13, 8, 0}, {141, 8, 0}, {77, 8, 0}, {251, 9, 0},
+    {257, 7, 0}, {83, 8, 0}, {19, 8, 0}, {283, 8, 0},
+    {273, 7, 0}, {115, 8, 0}, {51, 8, 0}, {199, 9, 0},
+    {265, 7, 0}, {99, 8, 0}, {35, 8, 0}, {167, 9, 0},
+    {3, 8, 0}, {131, 8, 0}, {67, 8, 0}, {231, 9, 0},
+    {261, 7, 0}, {91, 8, 0}, {27, 8, 0}, {151, 9, 0},
+    {277, 7, 0}, {123, 8, 0}, {59, 8, 0}, {215, 9, 0},
+    {269, 7, 0}, {107, 8, 0}, {43, 8, 0}, {183, 9, 0},
+    {11, 8, 0}, {139, 8, 0}, {75, 8, 0}, {247, 9, 0},
+    {259, 7, 0}, {87, 8, 0}, {23, 8, 0}, {287, 8, 0},
+    {275, 7, 0}, {119, 8, 0}, {55, 8, 0}, {207, 9, 0},
+    {267, 7, 0}, {103, 8, 0}, {39, 8, 0}, {175, 9, 0},
+    {7, 8, 0}, {135, 8, 0}, {71, 8, 0}, {239, 9, 0},
+    {263, 7, 0}, {95, 8, 0}, {31, 8, 0}, {159, 9, 0},
+    {279, 7, 0}, {127, 8, 0}, {63, 8, 0}, {223, 9, 0},
+    {271, 7, 0}, {111, 8, 0}, {47, 8, 0}, {191, 9, 0},
+    {15, 8, 0}, {143, 8, 0}, {79, 8, 0}, {255, 9, 0},
+};
+
+const struct huffman_table fixed_ll_table = {fixed_ll_table_entries, 512, 9};
+
+static const struct huffman_entry fixed_d_table_entries[64] = {
+    {0, 5, 0}, {16, 5, 0}, {8, 5, 0}, {24, 5, 0},
+    {4, 5, 0}, {20, 5, 0}, {12, 5, 0}, {28, 5, 0},
+    {2, 5, 0}, {18, 5, 0}, {10, 5, 0}, {26, 5, 0},
+    {6, 5, 0}, {22, 5, 0}, {14, 5, 0}, {0, 0, 0},
+    {1, 5, 0}, {17, 5, 0}, {9, 5, 0}, {25, 5, 0},
+    {5, 5, 0}, {21, 5, 0}, {13, 5, 0}, {29, 5, 0},
+    {3, 5, 0}, {19, 5, 0}, {11, 5, 0}, {27, 5, 0},
+    {7, 5, 0}, {23, 5, 0}, {15, 5, 0}, {0, 0, 0},
+    {0, 5, 0}, {16, 5, 0}, {8, 5, 0}, {24, 5, 0},
+    {4, 5, 0}, {20, 5, 0}, {12, 5, 0}, {28, 5, 0},
+    {2, 5, 0}, {18, 5, 0}, {10, 5, 0}, {26, 5, 0},
+    {6, 5, 0}, {22, 5, 0}, {14, 5, 0}, {0, 0, 0},
+    {1, 5, 0}, {17, 5, 0}, {9, 5, 0}, {25, 5, 0},
+    {5, 5, 0}, {21, 5, 0}, {13, 5, 0}, {29, 5, 0},
+    {3, 5, 0}, {19, 5, 0}, {11, 5, 0}, {27, 5, 0},
+    {7, 5, 0}, {23, 5, 0}, {15, 5, 0}, {0, 0, 0},
+};
+
+const struct huffman_table fixed_d_table = {fixed_d_table_entries, 64, 6};
+
+static const struct huffman_entry fixed_ll_value_table_entries[512] = {
+    {256, 7, 0}, {80, 8, 0}, {16, 8, 0}, {115, 8, 68},
+    {31, 9, 64}, {112, 8, 0}, {48, 8, 0}, {192, 9, 0},
+    {10, 7, 64}, {96, 8, 0}, {32, 8, 0}, {160, 9, 0},
+    {0, 8, 0}, {128, 8, 0}, {64, 8, 0}, {224, 9, 0},
+    {6, 7, 64}, {88, 8, 0}, {24, 8, 0}, {144, 9, 0},
+    {59, 7, 67}, {120, 8, 0}, {56, 8, 0}, {208, 9, 0},
+    {17, 8, 64}, {104, 8, 0}, {40, 8, 0}, {176, 9, 0},
+    {8, 8, 0}, {136, 8, 0}, {72, 8, 0}, {240, 9, 0},
+    {4, 7, 64}, {84, 8, 0}, {20, 8, 0}, {227, 8, 69},
+    {43, 7, 67}, {116, 8, 0}, {52, 8, 0}, {200, 9, 0},
+    {13, 8, 64}, {100, 8, 0}, {36, 8, 0}, {168, 9, 0},
+    {4, 8, 0}, {132, 8, 0}, {68, 8, 0}, {232, 9, 0},
+    {8, 7, 64}, {92, 8, 0}, {28, 8, 0}, {152, 9, 0},
+    {83, 7, 68}, {124, 8, 0}, {60, 8, 0}, {216, 9, 0},
+    {23, 9, 64}, {108, 8, 0}, {44, 8, 0}, {184, 9, 0},
+    {12, 8, 0}, {140, 8, 0}, {76, 8, 0}, {248, 9, 0},
+    {3, 7, 64}, {82, 8, 0}, {18, 8, 0}, {163, 8, 69},
+    {35, 7, 67}, {114, 8, 0}, {50, 8, 0}, {196, 9, 0},
+    {11, 8, 64}, {98, 8, 0}, {34, 8, 0}, {164, 9, 0},
+    {2, 8, 0}, {130, 8, 0}, {66, 8, 0}, {228, 9, 0},
+    {7, 7, 64}, {90, 8, 0}, {26, 8, 0}, {148, 9, 0},
+    {67, 7, 68}, {122, 8, 0}, {58, 8, 0}, {212, 9, 0},
+    {19, 9, 64}, {106, 8, 0}, {42, 8, 0}, {180, 9, 0},
+    {10, 8, 0}, {138, 8, 0}, {74, 8, 0}, {244, 9, 0},
+    {5, 7, 64}, {86, 8, 0}, {22, 8, 0}, {286, 8, 0},
+    {51, 7, 67}, {118, 8, 0}, {54, 8, 0}, {204, 9, 0},
+    {15, 8, 64}, {102, 8, 0}, {38, 8, 0}, {172, 9, 0},
+    {6, 8, 0}, {134, 8, 0}, {70, 8, 0}, {236, 9, 0},
+    {9, 7, 64}, {94, 8, 0}, {30, 8, 0}, {156, 9, 0},
+    {99, 7, 68}, {126, 8, 0}, {62, 8, 0}, {220, 9, 0},
+    {27, 9, 64}, {110, 8, 0}, {46, 8, 0}, {188, 9, 0},
+    {14, 8, 0}, {142, 8, 0}, {78, 8, 0}, {252, 9, 0},
+    {256, 7, 0}, {81, 8, 0}, {17, 8, 0}, {131, 8, 69},
+    {32, 9, 64}, {113, 8, 0}, {49, 8, 0}, {194, 9, 0},
+    {10, 7, 64}, {97, 8, 0}, {33, 8, 0}, {162, 9, 0},
+    {1, 8, 0}, {129, 8, 0}, {65, 8, 0}, {226, 9, 0},
+    {6, 7, 64}, {89, 8, 0}, {25, 8, 0}, {146, 9, 0},
+    {59, 7, 67}, {121, 8, 0}, {57, 8, 0}, {210, 9, 0},
+    {18, 8, 64}, {105, 8, 0}, {41, 8, 0}, {178, 9, 0},
+    {9, 8, 0}, {137, 8, 0}, {73, 8, 0}, {242, 9, 0},
+    {4, 7, 64}, {85, 8, 0}, {21, 8, 0}, {258, 8, 64},
+    {43, 7, 67}, {117, 8, 0}, {53, 8, 0}, {202, 9, 0},
+    {14, 8, 64}, {101, 8, 0}, {37, 8, 0}, {170, 9, 0},
+    {5, 8, 0}, {133, 8, 0}, {69, 8, 0}, {234, 9, 0},
+    {8, 7, 64}, {93, 8, 0}, {29, 8, 0}, {154, 9, 0},
+    {83, 7, 68}, {125, 8, 0}, {61, 8, 0}, {218, 9, 0},
+    {24, 9, 64}, {109, 8, 0}, {45, 8, 0}, {186, 9, 0},
+    {13, 8, 0}, {141, 8, 0}, {77, 8, 0}, {250, 9, 0},
+    {3, 7, 64}, {83, 8, 0}, {19, 8, 0}, {195, 8, 69},
+    {35, 7, 67}, {115, 8, 0}, {51, 8, 0}, {198, 9, 0},
+    {12, 8, 64}, {99, 8, 0}, {35, 8, 0}, {166, 9, 0},
+    {3, 8, 0}, {131, 8, 0}, {67, 8, 0}, {230, 9, 0},
+    {7, 7, 64}, {91, 8, 0}, {27, 8, 0}, {150, 9, 0},
+    {67, 7, 68}, {123, 8, 0}, {59, 8, 0}, {214, 9, 0},
+    {20, 9, 64}, {107, 8, 0}, {43, 8, 0}, {182, 9, 0},
+    {11, 8, 0}, {139, 8, 0}, {75, 8, 0}, {246, 9, 0},
+    {5, 7, 64}, {87, 8, 0}, {23, 8, 0}, {287, 8, 0},
+    {51, 7, 67}, {119, 8, 0}, {55, 8, 0}, {206, 9, 0},
+    {16, 8, 64}, {103, 8, 0}, {39, 8, 0}, {174, 9, 0},
+    {7, 8, 0}, {135, 8, 0}, {71, 8, 0}, {238, 9, 0},
+    {9, 7, 64}, {95, 8, 0}, {31, 8, 0}, {158, 9, 0},
+    {99, 7, 68}, {127, 8, 0}, {63, 8, 0}, {222, 9, 0},
+    {28, 9, 64}, {111, 8, 0}, {47, 8, 0}, {190, 9, 0},
+    {15, 8, 0}, {143, 8, 0}, {79, 8, 0}, {254, 9, 0},
+    {256, 7, 0}, {80, 8, 0}, {16, 8, 0}, {115, 8, 68},
+    {33, 9, 64}, {112, 8, 0}, {48, 8, 0}, {193, 9, 0},
+    {10, 7, 64}, {96, 8, 0}, {32, 8, 0}, {161, 9, 0},
+    {0, 8, 0}, {128, 8, 0}, {64, 8, 0}, {225, 9, 0},
+    {6, 7, 64}, {88, 8, 0}, {24, 8, 0}, {145, 9, 0},
+    {59, 7, 67}, {120, 8, 0}, {56, 8, 0}, {209, 9, 0},
+    {17, 8, 64}, {104, 8, 0}, {40, 8, 0}, {177, 9, 0},
+    {8, 8, 0}, {136, 8, 0}, {72, 8, 0}, {241, 9, 0},
+    {4, 7, 64}, {84, 8, 0}, {20, 8, 0}, {227, 8, 69},
+    {43, 7, 67}, {116, 8, 0}, {52, 8, 0}, {201, 9, 0},
+    {13, 8, 64}, {100, 8, 0}, {36, 8, 0}, {169, 9, 0},
+    {4, 8, 0}, {132, 8, 0}, {68, 8, 0}, {233, 9, 0},
+    {8, 7, 64}, {92, 8, 0}, {28, 8, 0}, {153, 9, 0},
+    {83, 7, 68}, {124, 8, 0}, {60, 8, 0}, {217, 9, 0},
+    {25, 9, 64}, {108, 8, 0}, {44, 8, 0}, {185, 9, 0},
+    {12, 8, 0}, {140, 8, 0}, {76, 8, 0}, {249, 9, 0},
+    {3, 7, 64}, {82, 8, 0}, {18, 8, 0}, {163, 8, 69},
+    {35, 7, 67}, {114, 8, 0}, {50, 8, 0}, {197, 9, 0},
+    {11, 8, 64}, {98, 8, 0}, {34, 8, 0}, {165, 9, 0},
+    {2, 8, 0}, {130, 8, 0}, {66, 8, 0}, {229, 9, 0},
+    {7, 7, 64}, {90, 8, 0}, {26, 8, 0}, {149, 9, 0},
+    {67, 7, 68}, {122, 8, 0}, {58, 8, 0}, {213, 9, 0},
+    {21, 9, 64}, {106, 8, 0}, {42, 8, 0}, {181, 9, 0},
+    {10, 8, 0}, {138, 8, 0}, {74, 8, 0}, {245, 9, 0},
+    {5, 7, 64}, {86, 8, 0}, {22, 8, 0}, {286, 8, 0},
+    {51, 7, 67}, {118, 8, 0}, {54, 8, 0}, {205, 9, 0},
+    {15, 8, 64}, {102, 8, 0}, {38, 8, 0}, {173, 9, 0},
+    {6, 8, 0}, {134, 8, 0}, {70, 8, 0}, {237, 9, 0},
+    {9, 7, 64}, {94, 8, 0}, {30, 8, 0}, {157, 9, 0},
+    {99, 7, 68}, {126, 8, 0}, {62, 8, 0}, {221, 9, 0},
+    {29, 9, 64}, {110, 8, 0}, {46, 8, 0}, {189, 9, 0},
+    {14, 8, 0}, {142, 8, 0}, {78, 8, 0}, {253, 9, 0},
+    {256, 7, 0}, {81, 8, 0}, {17, 8, 0}, {131, 8, 69},
+    {34, 9, 64}, {113, 8, 0}, {49, 8, 0}, {195, 9, 0},
+    {10, 7, 64}, {97, 8, 0}, {33, 8, 0}, {163, 9, 0},
+    {1, 8, 0}, {129, 8, 0}, {65, 8, 0}, {227, 9, 0},
+    {6, 7, 64}, {89, 8, 0}, {25, 8, 0}, {147, 9, 0},
+    {59, 7, 67}, {121, 8, 0}, {57, 8, 0}, {211, 9, 0},
+    {18, 8, 64}, {105, 8, 0}, {41, 8, 0}, {179, 9, 0},
+    {9, 8, 0}, {137, 8, 0}, {73, 8, 0}, {243, 9, 0},
+    {4, 7, 64}, {85, 8, 0}, {21, 8, 0}, {258, 8, 64},
+    {43, 7, 67}, {117, 8, 0}, {53, 8, 0}, {203, 9, 0},
+    {14, 8, 64}, {101, 8, 0}, {37, 8, 0}, {171, 9, 0},
+    {5, 8, 0}, {133, 8, 0}, {69, 8, 0}, {235, 9, 0},
+    {8, 7, 64}, {93, 8, 0}, {29, 8, 0}, {155, 9, 0},
+    {83, 7, 68}, {125, 8, 0}, {61, 8, 0}, {219, 9, 0},
+    {26, 9, 64}, {109, 8, 0}, {45, 8, 0}, {187, 9, 0},
+    {13, 8, 0}, {141, 8, 0}, {77, 8, 0}, {251, 9, 0},
+    {3, 7, 64}, {83, 8, 0}, {19, 8, 0}, {195, 8, 69},
+    {35, 7, 67}, {115, 8, 0}, {51, 8, 0}, {199, 9, 0},
+    {12, 8, 64}, {99, 8, 0}, {35, 8, 0}, {167, 9, 0},
+    {3, 8, 0}, {131, 8, 0}, {67, 8, 0}, {231, 9, 0},
+    {7, 7, 64}, {91, 8, 0}, {27, 8, 0}, {151, 9, 0},
+    {67, 7, 68}, {123, 8, 0}, {59, 8, 0}, {215, 9, 0},
+    {22, 9, 64}, {107, 8, 0}, {43, 8, 0}, {183, 9, 0},
+    {11, 8, 0}, {139, 8, 0}, {75, 8, 0}, {247, 9, 0},
+    {5, 7, 64}, {87, 8, 0}, {23, 8, 0}, {287, 8, 0},
+    {51, 7, 67}, {119, 8, 0}, {55, 8, 0}, {207, 9, 0},
+    {16, 8, 64}, {103, 8, 0}, {39, 8, 0}, {175, 9, 0},
+    {7, 8, 0}, {135, 8, 0}, {71, 8, 0}, {239, 9, 0},
+    {9, 7, 64}, {95, 8, 0}, {31, 8, 0}, {159, 9, 0},
+    {99, 7, 68}, {127, 8, 0}, {63, 8, 0}, {223, 9, 0},
+    {30, 9, 64}, {111, 8, 0}, {47, 8, 0}, {191, 9, 0},
+    {15, 8, 0}, {143, 8, 0}, {79, 8, 0}, {255, 9, 0},
+};
+
+const struct huffman_table fixed_ll_value_table = {fixed_ll_value_table_entries, 512, 9};
+
+static const struct huffman_entry fixed_d_value_table_entries[64] = {
+    {1, 5, 64}, {257, 5, 71}, {17, 5, 67}, {4097, 5, 75},
+    {5, 6, 64}, {1025, 5, 73}, {65, 5, 69}, {16385, 5, 77},
+    {3, 5, 64}, {513, 5, 72}, {33, 5, 68}, {8193, 5, 76},
+    {9, 5, 66}, {2049, 5, 74}, {129, 5, 70}, {0, 0, 0},
+    {2, 5, 64}, {385, 5, 71}, {25, 5, 67}, {6145, 5, 75},
+    {7, 6, 64}, {1537, 5, 73}, {97, 5, 69}, {24577, 5, 77},
+    {4, 5, 64}, {769, 5, 72}, {49, 5, 68}, {12289, 5, 76},
+    {13, 5, 66}, {3073, 5, 74}, {193, 5, 70}, {0, 0, 0},
+    {1, 5, 64}, {257, 5, 71}, {17, 5, 67}, {4097, 5, 75},
+    {6, 6, 64}, {1025, 5, 73}, {65, 5, 69}, {16385, 5, 77},
+    {3, 5, 64}, {513, 5, 72}, {33, 5, 68}, {8193, 5, 76},
+    {9, 5, 66}, {2049, 5, 74}, {129, 5, 70}, {0, 0, 0},
+    {2, 5, 64}, {385, 5, 71}, {25, 5, 67}, {6145, 5, 75},
+    {8, 6, 64}, {1537, 5, 73}, {97, 5, 69}, {24577, 5, 77},
+    {4, 5, 64}, {769, 5, 72}, {49, 5, 68}, {12289, 5, 76},
+    {13, 5, 66}, {3073, 5, 74}, {193, 5, 70}, {0, 0, 0},
+};
+
+const struct huffman_table fixed_d_value_table = {fixed_d_value_table_entries, 64, 6};
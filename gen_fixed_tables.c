@@ -0,0 +1,56 @@
+#include "deflate.h"
+#include "huffman_table.h"
+
+#include <stdio.h>
+#include <inttypes.h>
+#include <stdbool.h>
+
+// writes the tables of the fixed codes as C source to stdout, the
+// Makefile turns it into fixed_tables.c
+
+static void print_table(const char *name, struct huffman_table *table)
+{
+    printf("static const struct huffman_entry %s_entries[%u] = {\n", name,
+           table->size);
+    for (uint16_t i = 0; i < table->size; ++i) {
+        const struct huffman_entry *entry = &table->entries[i];
+        printf("%s{%u, %u, %u},%s", i % 4 ? " " : "    ", entry->symbol,
+               entry->len, entry->sub_bits, i % 4 == 3 ? "\n" : "");
+    }
+    if (table->size % 4)
+        printf("\n");
+    printf("};\n\n");
+
+    printf("const struct huffman_table %s = {%s_entries, %u, %u};\n", name,
+           name, table->size, table->primary_bits);
+    return;
+}
+
+int main()
+{
+    struct huffman_table ll_table;
+    struct huffman_table d_table;
+    struct huffman_entry ll_entries[LL_TABLE_ENTRIES];
+    struct huffman_entry d_entries[D_TABLE_ENTRIES];
+    struct huffman_table ll_value_table;
+    struct huffman_table d_value_table;
+    struct huffman_entry ll_value_entries[LL_TABLE_ENTRIES];
+    struct huffman_entry d_value_entries[D_TABLE_ENTRIES];
+    if (!create_fixed_tables(false, &ll_table, ll_entries, &d_table,
+                             d_entries) ||
+        !create_fixed_tables(true, &ll_value_table, ll_value_entries,
+                             &d_value_table, d_value_entries))
+        return 1;
+
+    printf("// generated by gen_fixed_tables, do not edit\n\n");
+    printf("#include \"deflate.h\"\n");
+    printf("#include \"huffman_table.h\"\n\n");
+    print_table("fixed_ll_table", &ll_table);
+    printf("\n");
+    print_table("fixed_d_table", &d_table);
+    printf("\n");
+    print_table("fixed_ll_value_table", &ll_value_table);
+    printf("\n");
+    print_table("fixed_d_value_table", &d_value_table);
+    return 0;
+}
@@ -0,0 +1,184 @@
+#include "huffman_table.h"
+#include "log.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#define MAX_PRIMARY_BITS 12
+#define MAX_CODE_LENGTH 15
+
+// huffman codes are packed starting with the most significant bit of
+// the code but the input is read starting with the least significant
+// bit, so the tables are indexed by the bit reversed codes
+// ref: https://www.rfc-editor.org/rfc/rfc1951.txt section 3.1.1
+static inline uint16_t reverse_code(uint16_t code, uint8_t len)
+{
+    code = (uint16_t) (((code & 0x5555) << 1) | ((code >> 1) & 0x5555));
+    code = (uint16_t) (((code & 0x3333) << 2) | ((code >> 2) & 0x3333));
+    code = (uint16_t) (((code & 0x0f0f) << 4) | ((code >> 4) & 0x0f0f));
+    code = (uint16_t) ((code << 8) | (code >> 8));
+    return (uint16_t) (code >> (16 - len));
+}
+
+bool create_huffman_table(const uint8_t *code_lengths, uint16_t length,
+                          uint8_t max_huffman_code_length,
+                          uint8_t primary_bits, struct huffman_entry *entries,
+                          uint32_t max_entries, struct huffman_table *table)
+{
+    return create_huffman_value_table(code_lengths, length,
+                                      max_huffman_code_length, primary_bits,
+                                      NULL, entries, max_entries, table);
+}
+
+bool create_huffman_value_table(const uint8_t *code_lengths, uint16_t length,
+                                uint8_t max_huffman_code_length,
+                                uint8_t primary_bits,
+                                const struct huffman_values *values,
+                                struct huffman_entry *entries,
+                                uint32_t max_entries,
+                                struct huffman_table *table)
+{
+    if (length > 288) {
+        log_error("Expecting number of code lengths to be less than 288\n");
+        return false;
+    }
+
+    if (primary_bits == 0 || primary_bits > MAX_PRIMARY_BITS) {
+        log_error("Expecting primary table bits to be between 1 "
+                  "and %d\n", MAX_PRIMARY_BITS);
+        return false;
+    }
+
+    uint16_t counts[MAX_CODE_LENGTH + 1] = {0};
+    for (uint16_t i = 0; i < length; ++i) {
+        if (code_lengths[i] > max_huffman_code_length ||
+            code_lengths[i] > MAX_CODE_LENGTH) {
+            log_error("Unexpected huffman code length\n");
+            return false;
+        }
+        counts[code_lengths[i]]++;
+    }
+
+    // left counts the codes of each length that aren't taken by shorter
+    // ones, running out of them means the lengths are over-subscribed.
+    // Codes left at the end make the code incomplete
+    int32_t left = 1;
+    for (uint8_t len = 1; len <= MAX_CODE_LENGTH; ++len) {
+        left = 2 * left - counts[len];
+        if (left < 0) {
+            log_error("Over-subscribed huffman code lengths\n");
+            return false;
+        }
+    }
+
+    // the codes of each length are consecutive and follow the codes
+    // of the length before
+    uint16_t next_code[MAX_CODE_LENGTH + 1];
+    uint16_t code = 0;
+    counts[0] = 0;
+    for (uint8_t len = 1; len <= MAX_CODE_LENGTH; ++len) {
+        code = (uint16_t) ((code + counts[len - 1]) << 1);
+        next_code[len] = code;
+    }
+
+    uint16_t revs[288];
+    for (uint16_t i = 0; i < length; ++i) {
+        uint8_t len = code_lengths[i];
+        if (len)
+            revs[i] = reverse_code(next_code[len]++, len);
+    }
+
+    uint16_t primary_size = (uint16_t) (1u << primary_bits);
+    uint16_t primary_mask = primary_size - 1;
+
+    // the longest code sharing a primary slot decides the size of the
+    // sub-table linked from that slot
+    uint8_t sub_bits[1 << MAX_PRIMARY_BITS];
+    memset(sub_bits, 0, primary_size);
+    for (uint16_t i = 0; i < length; ++i) {
+        if (code_lengths[i] <= primary_bits)
+            continue;
+        uint16_t slot = revs[i] & primary_mask;
+        uint8_t bits = code_lengths[i] - primary_bits;
+        if (bits > sub_bits[slot])
+            sub_bits[slot] = bits;
+    }
+
+    uint32_t size = primary_size;
+    for (uint16_t slot = 0; slot < primary_size; ++slot) {
+        if (sub_bits[slot])
+            size += 1u << sub_bits[slot];
+    }
+    if (size > max_entries) {
+        log_error("Huffman table doesn't fit %" PRIu32 " entries\n",
+                  max_entries);
+        return false;
+    }
+
+    // zeroed entries have len 0 which marks codes that don't exist
+    memset(entries, 0, size * sizeof(struct huffman_entry));
+
+    uint32_t next_sub_table = primary_size;
+    for (uint16_t slot = 0; slot < primary_size; ++slot) {
+        if (!sub_bits[slot])
+            continue;
+        entries[slot].symbol = (uint16_t) next_sub_table;
+        entries[slot].len = primary_bits;
+        entries[slot].sub_bits = sub_bits[slot];
+        next_sub_table += 1u << sub_bits[slot];
+    }
+
+    // a code fills every entry whose index starts with its bits
+    for (uint16_t i = 0; i < length; ++i) {
+        uint8_t len = code_lengths[i];
+        if (len == 0)
+            continue;
+
+        struct huffman_entry *sub_table = entries;
+        uint32_t sub_size = primary_size;
+        uint32_t index = revs[i];
+        uint32_t step = 1u << len;
+        if (len > primary_bits) {
+            struct huffman_entry *link = &entries[revs[i] & primary_mask];
+            sub_table = entries + link->symbol;
+            sub_size = 1u << link->sub_bits;
+            index = revs[i] >> primary_bits;
+            step = 1u << (len - primary_bits);
+        }
+
+        if (values == NULL || i < values->first ||
+            i - values->first >= values->cnt) {
+            for (; index < sub_size; index += step) {
+                sub_table[index].symbol = i;
+                sub_table[index].len = len;
+            }
+            continue;
+        }
+
+        // primary entries get the value of the extra bits in their index
+        // if all of them are in it
+        const struct value_and_bits *vb = &values->data[i - values->first];
+        uint32_t mask = (1u << vb->extra_bits) - 1;
+        bool resolve = len + vb->extra_bits <= primary_bits;
+        for (; index < sub_size; index += step) {
+            uint32_t value = vb->value + ((index >> len) & mask);
+            if (resolve && value <= values->max) {
+                sub_table[index].symbol = (uint16_t) value;
+                sub_table[index].len = (uint8_t) (len + vb->extra_bits);
+                sub_table[index].sub_bits = VALUE_EXTRA;
+            } else {
+                sub_table[index].symbol = vb->value;
+                sub_table[index].len = len;
+                sub_table[index].sub_bits =
+                    (uint8_t) (VALUE_EXTRA + vb->extra_bits);
+            }
+        }
+    }
+
+    table->entries = entries;
+    table->size = (uint16_t) size;
+    table->primary_bits = primary_bits;
+    return true;
+}
@@ -0,0 +1,63 @@
+#ifndef HUFFMAN_TABLE
+#define HUFFMAN_TABLE
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+struct huffman_entry {
+    uint16_t symbol;  // decoded symbol or offset of the sub-table
+    uint8_t len;      // length of the code in bits, 0 if no code maps here
+    uint8_t sub_bits; // if non-zero, bits indexing the sub-table at symbol
+};
+
+// sub_bits of sub-table links are below VALUE_EXTRA. An entry of a value
+// table whose symbol stands for a value has sub_bits VALUE_EXTRA plus the
+// number of extra bits following the code and that value in symbol. If
+// the extra bits are in the primary index as well, len counts them and
+// symbol is the value with them added, leaving no extra bits
+#define VALUE_EXTRA 0x40
+
+struct value_and_bits {
+    uint16_t value;       // value of the length or distance code
+    uint8_t extra_bits;   // extra bits to read after the code
+};
+
+// symbols first to first + cnt - 1 stand for the values in data. Values
+// with extra bits above max are never resolved, so decoders can reject
+// them from the extra bits still left
+struct huffman_values {
+    uint16_t first;
+    uint16_t cnt;
+    const struct value_and_bits *data;
+    uint16_t max;
+};
+
+// primary table indexed by the next primary_bits input bits followed
+// by the sub-tables of the codes longer than primary_bits
+struct huffman_table {
+    const struct huffman_entry *entries;
+    uint16_t size;        // number of entries in primary and sub-tables
+    uint8_t primary_bits; // bits used to index primary table
+};
+
+// builds the table of the canonical code with the given code lengths in
+// entries, which has room for max_entries. Nothing is allocated, the
+// table points into entries. Over-subscribed code lengths are invalid,
+// incomplete ones leave the entries of missing codes with len 0, which
+// fails if their sub-tables would take more than max_entries
+// ref: https://www.rfc-editor.org/rfc/rfc1951.txt section 3.2.2
+bool create_huffman_table(const uint8_t *code_lengths, uint16_t length,
+                          uint8_t max_huffman_code_length,
+                          uint8_t primary_bits, struct huffman_entry *entries,
+                          uint32_t max_entries, struct huffman_table *table);
+
+// the same with value entries for the symbols standing for values
+bool create_huffman_value_table(const uint8_t *code_lengths, uint16_t length,
+                                uint8_t max_huffman_code_length,
+                                uint8_t primary_bits,
+                                const struct huffman_values *values,
+                                struct huffman_entry *entries,
+                                uint32_t max_entries,
+                                struct huffman_table *table);
+
+#endif
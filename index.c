@@ -0,0 +1,171 @@
+#include "index.h"
+#include "index_file.h"
+#include "decompress.h"
+#include "deflate.h"
+#include "log.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <malloc.h>
+#include <sys/mman.h>
+
+void init_index(struct gzip_index *index, uint64_t span)
+{
+    index->span = span;
+    index->points = NULL;
+    index->cnt = 0;
+    index->size = 0;
+    index->out_size = 0;
+    index->map = NULL;
+    index->map_len = 0;
+    return;
+}
+
+void free_index(struct gzip_index *index)
+{
+    if (index == NULL)
+        return;
+
+    for (size_t i = 0; i < index->cnt && index->points != NULL; ++i)
+        free(index->points[i].window);
+    free(index->points);
+    if (index->map != NULL)
+        munmap((void *) index->map, index->map_len);
+    index->points = NULL;
+    index->map = NULL;
+    index->cnt = 0;
+    index->size = 0;
+    return;
+}
+
+bool add_checkpoint(struct gzip_index *index, uint64_t out_pos,
+                    uint64_t bit_pos, bool member_start,
+                    const uint8_t *window, size_t window_len)
+{
+    if (index->cnt == index->size) {
+        size_t size = index->size ? index->size * 2 : 16;
+        struct checkpoint *points = realloc(index->points,
+                                            size * sizeof(struct checkpoint));
+        if (points == NULL) {
+            log_error("Failed to allocate index checkpoints\n");
+            return false;
+        }
+        index->points = points;
+        index->size = size;
+    }
+
+    struct checkpoint *point = &index->points[index->cnt];
+    point->window = malloc(window_len ? window_len : 1);
+    if (point->window == NULL) {
+        log_error("Failed to allocate index checkpoint window\n");
+        return false;
+    }
+    if (window_len)
+        memcpy(point->window, window, window_len);
+
+    point->out_pos = out_pos;
+    point->bit_pos = bit_pos;
+    point->member_start = member_start;
+    point->window_len = (uint32_t) window_len;
+    index->cnt++;
+    return true;
+}
+
+bool build_index(uint8_t *buf, size_t buf_len, struct gzip_index *index)
+{
+    struct decompress_options options;
+    options.crc_thread = false;
+    options.threads = 1;
+    options.index = index;
+    options.write_size = DEFAULT_WRITE_SIZE;
+    options.stats = NULL;
+
+    struct sink sink;
+    init_discard_sink(&sink);
+    return decompress_members(buf, buf_len, &sink, &options);
+}
+
+static uint64_t checkpoint_out_pos(struct gzip_index *index, size_t i)
+{
+    if (index->map != NULL)
+        return index_record_out_pos(index, i);
+
+    return index->points[i].out_pos;
+}
+
+static bool checkpoint_member_start(struct gzip_index *index, size_t i)
+{
+    if (index->map != NULL)
+        return index_record_member_start(index, i);
+
+    return index->points[i].member_start;
+}
+
+// checkpoints of a mapped index file have their window expanded into
+// window which has room for MAX_DISTANCE bytes
+static bool get_checkpoint(struct gzip_index *index, size_t i,
+                           struct checkpoint *point, uint8_t *window)
+{
+    if (index->map != NULL)
+        return read_index_record(index, i, point, window);
+
+    *point = index->points[i];
+    return true;
+}
+
+// the last checkpoint at or before offset
+static size_t find_checkpoint(struct gzip_index *index, uint64_t offset)
+{
+    size_t lo = 0;
+    size_t hi = index->cnt;
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (checkpoint_out_pos(index, mid) <= offset)
+            lo = mid;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+bool extract_range(uint8_t *buf, size_t buf_len, struct gzip_index *index,
+                   uint64_t offset, uint64_t len, struct sink *sink)
+{
+    if (index->cnt == 0 || offset >= index->out_size)
+        return true;
+
+    uint8_t *window = malloc(MAX_DISTANCE);
+    if (window == NULL)
+        return false;
+
+    size_t i = find_checkpoint(index, offset);
+    bool success = true;
+    while (len > 0 && i < index->cnt) {
+        struct checkpoint point;
+        success = get_checkpoint(index, i, &point, window);
+        if (!success)
+            break;
+
+        uint64_t written = 0;
+        success = extract_blocks_at(buf, buf_len, point.bit_pos, point.window,
+                                    point.window_len, offset - point.out_pos,
+                                    len, sink, &written);
+        if (!success) {
+            log_error("Failed to decompress from checkpoint at %" PRIu64
+                      "\n", point.out_pos);
+            break;
+        }
+        offset += written;
+        len -= written;
+
+        // the range continues in the next member
+        while (++i < index->cnt && !checkpoint_member_start(index, i))
+            ;
+    }
+
+    free(window);
+    return success;
+}
@@ -0,0 +1,49 @@
+#ifndef INDEX
+#define INDEX
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+struct sink;
+
+#define DEFAULT_INDEX_SPAN 1048576
+
+// decoding can resume at a checkpoint given the output preceding it,
+// which back references of the blocks after it can reach
+// ref: zran.c in the zlib distribution
+struct checkpoint {
+    uint64_t out_pos;    // offset in the decompressed output of all members
+    uint64_t bit_pos;    // input offset in bits of the block starting here
+    bool member_start;   // first block of a member
+    uint32_t window_len; // up to 32768 bytes of member output before out_pos
+    uint8_t *window;
+};
+
+// checkpoints in order of out_pos, one at the start of every member and
+// one at the first block boundary after each span bytes of output
+struct gzip_index {
+    uint64_t span;
+    struct checkpoint *points; // checkpoints of an index built in memory
+    size_t cnt;
+    size_t size;         // allocated checkpoints
+    uint64_t out_size;   // decompressed size of the members indexed so far
+    const uint8_t *map;  // mapped index file the checkpoints are read from
+    size_t map_len;
+};
+
+void init_index(struct gzip_index *index, uint64_t span);
+void free_index(struct gzip_index *index);
+bool add_checkpoint(struct gzip_index *index, uint64_t out_pos,
+                    uint64_t bit_pos, bool member_start,
+                    const uint8_t *window, size_t window_len);
+
+// decompresses every member to index it without writing the output
+bool build_index(uint8_t *buf, size_t buf_len, struct gzip_index *index);
+
+// writes len bytes of decompressed output starting at offset to sink,
+// less if the output ends before
+bool extract_range(uint8_t *buf, size_t buf_len, struct gzip_index *index,
+                   uint64_t offset, uint64_t len, struct sink *sink);
+
+#endif
@@ -0,0 +1,318 @@
+#include "index_file.h"
+#include "index.h"
+#include "deflate.h"
+#include "speculative.h"
+#include "crc32.h"
+#include "sink.h"
+#include "log.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <malloc.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// bytes at each end of the gzip file covered by the CRC32 in the header,
+// the file size and mtime catch most other changes
+#define INDEX_CHECK_SIZE 32768
+
+#define CHECKPOINT_MEMBER_START 0x01u
+
+static const uint8_t index_magic[8] = {'U', 'N', 'G', 'Z', 'I', 'D', 'X', 0};
+
+static void put_le32(uint8_t *p, uint32_t value)
+{
+    for (uint8_t i = 0; i < 4; ++i)
+        p[i] = (uint8_t) (value >> (8 * i));
+    return;
+}
+
+static void put_le64(uint8_t *p, uint64_t value)
+{
+    for (uint8_t i = 0; i < 8; ++i)
+        p[i] = (uint8_t) (value >> (8 * i));
+    return;
+}
+
+static uint32_t get_le32(const uint8_t *p)
+{
+    uint32_t value = 0;
+    for (uint8_t i = 0; i < 4; ++i)
+        value |= (uint32_t) p[i] << (8 * i);
+    return value;
+}
+
+static uint64_t get_le64(const uint8_t *p)
+{
+    uint64_t value = 0;
+    for (uint8_t i = 0; i < 8; ++i)
+        value |= (uint64_t) p[i] << (8 * i);
+    return value;
+}
+
+static uint32_t gzip_file_crc(uint8_t *buf, size_t buf_len)
+{
+    size_t len = buf_len < INDEX_CHECK_SIZE ? buf_len : INDEX_CHECK_SIZE;
+    uint32_t crc = crc32_update(0, buf, len);
+    return crc32_update(crc, buf + buf_len - len, len);
+}
+
+static void put_header(uint8_t *header, struct gzip_index *index,
+                       struct stat *gz_stat, uint8_t *buf, size_t buf_len,
+                       uint32_t data_crc)
+{
+    memset(header, 0, INDEX_HEADER_SIZE);
+    memcpy(header, index_magic, sizeof(index_magic));
+    put_le32(header + 8, INDEX_VERSION);
+    put_le32(header + 12, INDEX_RECORD_SIZE);
+    put_le64(header + 16, (uint64_t) gz_stat->st_size);
+    put_le64(header + 24, (uint64_t) gz_stat->st_mtim.tv_sec);
+    put_le32(header + 32, (uint32_t) gz_stat->st_mtim.tv_nsec);
+    put_le32(header + 36, gzip_file_crc(buf, buf_len));
+    put_le64(header + 40, index->span);
+    put_le64(header + 48, index->out_size);
+    put_le64(header + 56, index->cnt);
+    put_le32(header + 64, data_crc);
+    return;
+}
+
+// only runs of bytes that are used are kept
+static bool write_sparse_window(struct sink *sink, const uint8_t *window,
+                                size_t window_len, const bool *used)
+{
+    size_t i = 0;
+    while (i < window_len) {
+        size_t start = i;
+        while (i < window_len && !used[i])
+            i++;
+        if (i == window_len)
+            break;
+
+        size_t skip = i - start;
+        size_t run = 0;
+        while (i < window_len && used[i]) {
+            i++;
+            run++;
+        }
+
+        uint8_t counts[4] = {(uint8_t) skip, (uint8_t) (skip >> 8),
+                             (uint8_t) run, (uint8_t) (run >> 8)};
+        if (!write_sink(sink, counts, 4) ||
+            !write_sink(sink, window + i - run, run))
+            return false;
+    }
+
+    return true;
+}
+
+// encodes the windows one after the other into the memory sink windows
+// and puts the records of the checkpoints in records
+static bool encode_windows(struct gzip_index *index, uint8_t *buf,
+                           size_t buf_len, uint8_t *records,
+                           struct sink *windows)
+{
+    bool used[MAX_DISTANCE];
+    uint64_t windows_pos = INDEX_HEADER_SIZE +
+        (uint64_t) index->cnt * INDEX_RECORD_SIZE;
+    bool success = true;
+    for (size_t i = 0; i < index->cnt && success; ++i) {
+        struct checkpoint *point = &index->points[i];
+        size_t len = point->window_len;
+
+        // every byte is kept if the references can't be found
+        bool *window_used = used + MAX_DISTANCE - len;
+        if (len && !find_window_references(buf, buf_len, point->bit_pos,
+                                           used))
+            memset(used, 1, sizeof(used));
+
+        size_t start = windows->len;
+        success = write_sparse_window(windows, point->window, len,
+                                      window_used);
+
+        uint8_t *record = records + i * INDEX_RECORD_SIZE;
+        memset(record, 0, INDEX_RECORD_SIZE);
+        put_le64(record, point->out_pos);
+        put_le64(record + 8, point->bit_pos);
+        put_le64(record + 16, windows_pos + start);
+        put_le32(record + 24, (uint32_t) (windows->len - start));
+        put_le32(record + 28, point->window_len);
+        put_le32(record + 32, point->member_start ? CHECKPOINT_MEMBER_START :
+                 0);
+    }
+
+    return success;
+}
+
+bool write_index_file(struct gzip_index *index, const char *path,
+                      const char *gz_path, uint8_t *buf, size_t buf_len)
+{
+    if (index->map != NULL)
+        return false;
+
+    struct stat gz_stat;
+    if (stat(gz_path, &gz_stat) != 0) {
+        log_error("Failed to stat %s\n", gz_path);
+        return false;
+    }
+
+    uint8_t *records = malloc(index->cnt * INDEX_RECORD_SIZE + 1);
+    if (records == NULL)
+        return false;
+
+    struct sink windows;
+    init_memory_sink(&windows);
+    if (!encode_windows(index, buf, buf_len, records, &windows)) {
+        log_error("Failed to encode index windows\n");
+        free(records);
+        free(windows.buf);
+        return false;
+    }
+
+    size_t records_len = index->cnt * INDEX_RECORD_SIZE;
+    uint32_t data_crc = crc32_update(0, records, records_len);
+    if (windows.len)
+        data_crc = crc32_update(data_crc, windows.buf, windows.len);
+
+    uint8_t header[INDEX_HEADER_SIZE];
+    put_header(header, index, &gz_stat, buf, buf_len, data_crc);
+
+    bool success = false;
+    FILE *f = fopen(path, "wb");
+    if (f != NULL) {
+        success =
+            fwrite(header, 1, INDEX_HEADER_SIZE, f) == INDEX_HEADER_SIZE &&
+            fwrite(records, 1, records_len, f) == records_len &&
+            (windows.len == 0 ||
+             fwrite(windows.buf, 1, windows.len, f) == windows.len);
+        if (fclose(f) != 0)
+            success = false;
+        if (!success)
+            remove(path);
+    }
+    if (!success)
+        log_error("Failed to write index file %s\n", path);
+
+    free(records);
+    free(windows.buf);
+    return success;
+}
+
+bool open_index_file(const char *path, const char *gz_path, uint8_t *buf,
+                     size_t buf_len, struct gzip_index *index)
+{
+    struct stat gz_stat;
+    if (stat(gz_path, &gz_stat) != 0)
+        return false;
+
+    int fd = open(path, O_RDONLY);
+    if (fd == -1)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < INDEX_HEADER_SIZE) {
+        close(fd);
+        return false;
+    }
+
+    size_t map_len = (size_t) st.st_size;
+    uint8_t *map = mmap(NULL, map_len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return false;
+
+    uint64_t cnt = get_le64(map + 56);
+    if (memcmp(map, index_magic, sizeof(index_magic)) != 0 ||
+        get_le32(map + 8) != INDEX_VERSION ||
+        get_le32(map + 12) != INDEX_RECORD_SIZE ||
+        cnt > (map_len - INDEX_HEADER_SIZE) / INDEX_RECORD_SIZE) {
+        log_error("Invalid index file %s\n", path);
+        munmap(map, map_len);
+        return false;
+    }
+
+    if (get_le64(map + 16) != (uint64_t) gz_stat.st_size ||
+        get_le64(map + 24) != (uint64_t) gz_stat.st_mtim.tv_sec ||
+        get_le32(map + 32) != (uint32_t) gz_stat.st_mtim.tv_nsec ||
+        get_le32(map + 36) != gzip_file_crc(buf, buf_len)) {
+        log_error("Index file %s is out of date\n", path);
+        munmap(map, map_len);
+        return false;
+    }
+
+    // a damaged index is rebuilt like one that is out of date
+    if (get_le32(map + 64) != crc32_update(0, map + INDEX_HEADER_SIZE,
+                                           map_len - INDEX_HEADER_SIZE)) {
+        log_error("Index file %s is corrupt\n", path);
+        munmap(map, map_len);
+        return false;
+    }
+
+    init_index(index, get_le64(map + 40));
+    index->out_size = get_le64(map + 48);
+    index->cnt = (size_t) cnt;
+    index->map = map;
+    index->map_len = map_len;
+    return true;
+}
+
+uint64_t index_record_out_pos(struct gzip_index *index, size_t i)
+{
+    return get_le64(index->map + INDEX_HEADER_SIZE + i * INDEX_RECORD_SIZE);
+}
+
+bool index_record_member_start(struct gzip_index *index, size_t i)
+{
+    const uint8_t *record = index->map + INDEX_HEADER_SIZE +
+        i * INDEX_RECORD_SIZE;
+    return get_le32(record + 32) & CHECKPOINT_MEMBER_START;
+}
+
+// bytes of the window which aren't used are left zero
+bool read_index_record(struct gzip_index *index, size_t i,
+                       struct checkpoint *point, uint8_t *window)
+{
+    const uint8_t *record = index->map + INDEX_HEADER_SIZE +
+        i * INDEX_RECORD_SIZE;
+    uint64_t offset = get_le64(record + 16);
+    uint32_t size = get_le32(record + 24);
+    uint32_t window_len = get_le32(record + 28);
+    if (window_len > MAX_DISTANCE || offset > index->map_len ||
+        index->map_len - offset < size) {
+        log_error("Invalid index checkpoint\n");
+        return false;
+    }
+
+    memset(window, 0, window_len);
+    const uint8_t *p = index->map + offset;
+    const uint8_t *end = p + size;
+    size_t pos = 0;
+    while (p < end) {
+        if (end - p < 4) {
+            log_error("Invalid index checkpoint window\n");
+            return false;
+        }
+        size_t skip = p[0] + 256 * p[1];
+        size_t run = p[2] + 256 * p[3];
+        p += 4;
+        if (window_len - pos < skip || window_len - pos - skip < run ||
+            (size_t) (end - p) < run) {
+            log_error("Invalid index checkpoint window\n");
+            return false;
+        }
+        pos += skip;
+        memcpy(window + pos, p, run);
+        pos += run;
+        p += run;
+    }
+
+    point->out_pos = get_le64(record);
+    point->bit_pos = get_le64(record + 8);
+    point->member_start = get_le32(record + 32) & CHECKPOINT_MEMBER_START;
+    point->window_len = window_len;
+    point->window = window;
+    return true;
+}
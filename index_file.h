@@ -0,0 +1,47 @@
+#ifndef INDEX_FILE
+#define INDEX_FILE
+
+#include "index.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// an index is saved next to the gzip file as a header, fixed size records
+// for the checkpoints and their windows. Windows only keep the bytes that
+// back references after the checkpoint use, so a file of all the records
+// is mapped and nothing needs to be read until a checkpoint is used
+//
+// header, numbers are little endian
+//   magic "UNGZIDX\0", version (4), record size (4), gzip file size (8),
+//   gzip file mtime seconds (8) and nanoseconds (4), CRC32 of the first
+//   and last 32KiB of the gzip file (4), span (8), output size (8),
+//   checkpoint count (8), CRC32 of the records and windows (4), unused (4)
+// record
+//   out_pos (8), bit_pos (8), file offset of the window (8), encoded
+//   window size (4), window length (4), flags (4), unused (4)
+// window
+//   runs of a 2 byte count of unused bytes to skip, a 2 byte count of
+//   bytes n and the next n bytes of the window
+
+#define INDEX_VERSION 2
+#define INDEX_HEADER_SIZE 72
+#define INDEX_RECORD_SIZE 40
+
+// buf holds the gzip file at gz_path which index was built from
+bool write_index_file(struct gzip_index *index, const char *path,
+                      const char *gz_path, uint8_t *buf, size_t buf_len);
+
+// return false if there is no index file for the gzip file at gz_path
+// or if it was built from a different version of the file or is corrupt
+bool open_index_file(const char *path, const char *gz_path, uint8_t *buf,
+                     size_t buf_len, struct gzip_index *index);
+
+// checkpoint i of a mapped index file, its window is expanded into window
+// which needs room for 32768 bytes
+uint64_t index_record_out_pos(struct gzip_index *index, size_t i);
+bool index_record_member_start(struct gzip_index *index, size_t i);
+bool read_index_record(struct gzip_index *index, size_t i,
+                       struct checkpoint *point, uint8_t *window);
+
+#endif
@@ -0,0 +1,297 @@
+#include "input.h"
+#include "uring.h"
+#include "log.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <malloc.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define READ_SIZE 1048576
+
+// reads until end of file for inputs without a known size like pipes
+static bool read_input(int fd, size_t size_hint, struct input *in)
+{
+    size_t size = size_hint ? size_hint + 1 : READ_SIZE;
+    size_t len = 0;
+    uint8_t *buf = malloc(size);
+    if (buf == NULL)
+        return false;
+
+    while (true) {
+        if (len == size) {
+            if (size > SIZE_MAX / 2) {
+                free(buf);
+                return false;
+            }
+            uint8_t *tmp = realloc(buf, size * 2);
+            if (tmp == NULL) {
+                free(buf);
+                return false;
+            }
+            buf = tmp;
+            size *= 2;
+        }
+
+        ssize_t cnt = read(fd, buf + len, size - len);
+        if (cnt == -1) {
+            free(buf);
+            return false;
+        }
+        if (cnt == 0)
+            break;
+        len += (size_t) cnt;
+    }
+
+    in->buf = buf;
+    in->len = len;
+    in->mapped = false;
+    return true;
+}
+
+bool open_input(const char *filename, struct input *in)
+{
+    int fd = open(filename, O_RDONLY);
+    if (fd == -1)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return false;
+    }
+
+    // off_t is 64 bits but size_t may not be
+    if (S_ISREG(st.st_mode) && (uint64_t) st.st_size > SIZE_MAX) {
+        log_error("%s is too large to map\n", filename);
+        close(fd);
+        return false;
+    }
+
+    if (S_ISREG(st.st_mode) && st.st_size > 0) {
+        size_t len = (size_t) st.st_size;
+        void *map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            madvise(map, len, MADV_SEQUENTIAL);
+            close(fd);
+            in->buf = map;
+            in->len = len;
+            in->mapped = true;
+            return true;
+        }
+    }
+
+    size_t size_hint = S_ISREG(st.st_mode) ? (size_t) st.st_size : 0;
+    bool success = read_input(fd, size_hint, in);
+    close(fd);
+    return success;
+}
+
+void close_input(struct input *in)
+{
+    if (in->mapped)
+        munmap(in->buf, in->len);
+    else
+        free(in->buf);
+    in->buf = NULL;
+    in->len = 0;
+    return;
+}
+
+bool is_input_stream(const char *filename)
+{
+    if (strcmp(filename, "-") == 0)
+        return true;
+
+    struct stat st;
+    return stat(filename, &st) == 0 && !S_ISREG(st.st_mode);
+}
+
+// plain reads are used if io_uring can't be set up
+static void open_input_ring(struct input_stream *s)
+{
+    s->ring = malloc(sizeof(struct uring));
+    if (s->ring == NULL)
+        return;
+    if (!uring_init(s->ring, 4)) {
+        free(s->ring);
+        s->ring = NULL;
+        return;
+    }
+
+    struct iovec iov = {s->buf, INPUT_STREAM_SIZE};
+    s->fixed = uring_register_buffers(s->ring, &iov, 1);
+    return;
+}
+
+// waits for the read in flight, cancelling it first if it's not needed
+static int finish_read(struct input_stream *s, bool cancel)
+{
+    s->reading = false;
+    if (cancel) {
+        struct io_uring_sqe *sqe = uring_get_sqe(s->ring);
+        if (sqe != NULL) {
+            uring_prep_rw(sqe, IORING_OP_ASYNC_CANCEL, -1, NULL, 0, 0, 1);
+            uring_submit(s->ring);
+        }
+    }
+
+    struct io_uring_cqe cqe;
+    do {
+        if (!uring_wait(s->ring, &cqe))
+            return -EIO;
+    } while (cqe.user_data != 0);
+
+    return cqe.res;
+}
+
+static void close_input_ring(struct input_stream *s)
+{
+    if (s->reading)
+        finish_read(s, true);
+    uring_exit(s->ring);
+    free(s->ring);
+    s->ring = NULL;
+    return;
+}
+
+// reads into the free end of buf
+static bool start_read(struct input_stream *s)
+{
+    struct io_uring_sqe *sqe = uring_get_sqe(s->ring);
+    if (sqe == NULL)
+        return false;
+
+    uint8_t opcode = s->fixed ? IORING_OP_READ_FIXED : IORING_OP_READ;
+    uring_prep_rw(sqe, opcode, s->fd, s->buf + s->len,
+                  (uint32_t) (INPUT_STREAM_SIZE - s->len), (uint64_t) -1, 0);
+    if (!uring_submit(s->ring))
+        return false;
+
+    s->reading = true;
+    return true;
+}
+
+// adds the bytes of the read in flight, returns false if there were none
+static bool add_read(struct input_stream *s)
+{
+    int cnt = finish_read(s, false);
+    if (cnt == -EINTR || cnt == -EAGAIN)
+        return false;
+    if (cnt < 0) {
+        log_error("Failed to read input\n");
+        s->eof = true;
+        return false;
+    }
+    if (cnt == 0) {
+        s->eof = true;
+        return false;
+    }
+
+    s->len += (size_t) cnt;
+    return true;
+}
+
+// the read in flight is waited for before the buffer is moved, the next
+// one is started before decoding goes on
+static bool fill_input_ring(struct input_stream *s, size_t keep,
+                            const uint8_t **buf, size_t *buf_len)
+{
+    bool more = s->reading && add_read(s);
+    memmove(s->buf, s->buf + keep, s->len - keep);
+    s->len -= keep;
+
+    while (!more && !s->eof && s->len < INPUT_STREAM_SIZE) {
+        if (!start_read(s)) {
+            log_error("Failed to read input\n");
+            s->eof = true;
+            break;
+        }
+        more = add_read(s);
+    }
+
+    if (!s->eof && s->len < INPUT_STREAM_SIZE && !start_read(s)) {
+        log_error("Failed to read input\n");
+        s->eof = true;
+    }
+
+    *buf = s->buf;
+    *buf_len = s->len;
+    return more;
+}
+
+bool open_input_stream(const char *filename, struct input_stream *s,
+                       bool uring)
+{
+    s->buf = malloc(INPUT_STREAM_SIZE);
+    if (s->buf == NULL)
+        return false;
+
+    s->fd = strcmp(filename, "-") == 0 ? STDIN_FILENO :
+        open(filename, O_RDONLY);
+    if (s->fd == -1) {
+        free(s->buf);
+        return false;
+    }
+
+    s->len = 0;
+    s->eof = false;
+    s->ring = NULL;
+    s->fixed = false;
+    s->reading = false;
+    if (uring)
+        open_input_ring(s);
+    return true;
+}
+
+void close_input_stream(struct input_stream *s)
+{
+    if (s->ring != NULL)
+        close_input_ring(s);
+    if (s->fd != STDIN_FILENO)
+        close(s->fd);
+    free(s->buf);
+    s->buf = NULL;
+    return;
+}
+
+// waits for at least one more byte of input unless it ended
+bool fill_input_stream(void *arg, size_t keep, const uint8_t **buf,
+                       size_t *buf_len)
+{
+    struct input_stream *s = arg;
+    if (s->ring != NULL)
+        return fill_input_ring(s, keep, buf, buf_len);
+
+    memmove(s->buf, s->buf + keep, s->len - keep);
+    s->len -= keep;
+    *buf = s->buf;
+    *buf_len = s->len;
+
+    while (!s->eof && s->len < INPUT_STREAM_SIZE) {
+        ssize_t cnt = read(s->fd, s->buf + s->len, INPUT_STREAM_SIZE - s->len);
+        if (cnt == -1 && errno == EINTR)
+            continue;
+        if (cnt == -1) {
+            log_error("Failed to read input\n");
+            s->eof = true;
+            break;
+        }
+        if (cnt == 0) {
+            s->eof = true;
+            break;
+        }
+        s->len += (size_t) cnt;
+        *buf_len = s->len;
+        return true;
+    }
+
+    return false;
+}
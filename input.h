@@ -0,0 +1,50 @@
+#ifndef INPUT
+#define INPUT
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// the compressed file, mapped if possible so decoding starts on the first
+// pages while the rest is read ahead, and the pages are shared with the
+// page cache instead of copied. Inputs which can't be mapped are read
+// into a malloc buffer
+struct input {
+    uint8_t *buf;
+    size_t len;
+    bool mapped;
+};
+
+// input which isn't a regular file, like a pipe, is decoded while it is
+// read into a buffer of INPUT_STREAM_SIZE bytes, input already decoded
+// is dropped from its front to make room
+#define INPUT_STREAM_SIZE 1048576
+
+struct uring;
+
+struct input_stream {
+    int fd;
+    uint8_t *buf;
+    size_t len;
+    bool eof;
+    struct uring *ring; // NULL if the input is read with read(2)
+    bool fixed;         // buf is registered with ring
+    bool reading;       // a read into buf + len is in flight on ring
+};
+
+bool open_input(const char *filename, struct input *in);
+void close_input(struct input *in);
+
+// "-" is stdin
+bool is_input_stream(const char *filename);
+// with uring the next read is kept in flight on io_uring while the
+// input read before is decoded, if the kernel supports it
+bool open_input_stream(const char *filename, struct input_stream *s,
+                       bool uring);
+void close_input_stream(struct input_stream *s);
+
+// a bit_reader_fill for reading from s
+bool fill_input_stream(void *arg, size_t keep, const uint8_t **buf,
+                       size_t *buf_len);
+
+#endif
@@ -0,0 +1,5 @@
+#include "log.h"
+
+#include <stdbool.h>
+
+__thread bool quiet_errors = false;
@@ -0,0 +1,17 @@
+#ifndef LOG
+#define LOG
+
+#include <stdbool.h>
+#include <stdio.h>
+
+// set on threads decoding speculatively, where failing to decode is
+// expected and the caller reports errors itself
+extern __thread bool quiet_errors;
+
+#define log_error(...)                          \
+    do {                                        \
+        if (!quiet_errors)                      \
+            fprintf(stderr, __VA_ARGS__);       \
+    } while (0)
+
+#endif
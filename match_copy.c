@@ -0,0 +1,155 @@
+#include "match_copy.h"
+
+#include <inttypes.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MATCH_COPY_X86
+#endif
+
+// portable kernel copying 8 byte words when they don't overlap
+static void copy_match_scalar(uint8_t *out, uint16_t distance,
+                              uint16_t length)
+{
+    const uint8_t *from = out - distance;
+    uint8_t *end = out + length;
+
+    if (distance >= 8) {
+        do {
+            memcpy(out, from, 8);
+            out += 8;
+            from += 8;
+        } while (out < end);
+        return;
+    }
+
+    if (distance == 1) {
+        memset(out, *from, length);
+        return;
+    }
+
+    while (out < end)
+        *out++ = *from++;
+    return;
+}
+
+void (*copy_match)(uint8_t *out, uint16_t distance, uint16_t length) =
+    copy_match_scalar;
+
+struct match_copy_kernel match_copy_kernels[MAX_MATCH_COPY_KERNELS] = {
+    {"scalar", copy_match_scalar}
+};
+unsigned match_copy_kernel_cnt = 1;
+
+#ifdef MATCH_COPY_X86
+
+// for distances below 16 the vector holding the first distance bytes
+// repeated is stored again and again, advancing by the largest multiple
+// of distance that fits in the vector keeps the pattern in phase
+static uint8_t pattern_index[16][32]; // i % distance
+static uint8_t pattern_step_16[16];   // 16 - 16 % distance
+static uint8_t pattern_step_32[16];   // 32 - 32 % distance
+
+__attribute__((target("ssse3")))
+static void copy_match_ssse3(uint8_t *out, uint16_t distance,
+                             uint16_t length)
+{
+    const uint8_t *from = out - distance;
+    uint8_t *end = out + length;
+
+    if (distance >= 16) {
+        do {
+            _mm_storeu_si128((__m128i *) out,
+                             _mm_loadu_si128((const __m128i *) from));
+            out += 16;
+            from += 16;
+        } while (out < end);
+        return;
+    }
+
+    // for distance 1 every index is 0 which broadcasts the byte
+    __m128i pattern =
+        _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) from),
+                         _mm_loadu_si128((const __m128i *)
+                                         pattern_index[distance]));
+    uint8_t step = pattern_step_16[distance];
+    do {
+        _mm_storeu_si128((__m128i *) out, pattern);
+        out += step;
+    } while (out < end);
+    return;
+}
+
+__attribute__((target("avx2")))
+static void copy_match_avx2(uint8_t *out, uint16_t distance,
+                            uint16_t length)
+{
+    const uint8_t *from = out - distance;
+    uint8_t *end = out + length;
+
+    if (distance >= 32) {
+        do {
+            _mm256_storeu_si256((__m256i *) out,
+                                _mm256_loadu_si256((const __m256i *) from));
+            out += 32;
+            from += 32;
+        } while (out < end);
+        return;
+    }
+
+    if (distance >= 16) {
+        do {
+            _mm_storeu_si128((__m128i *) out,
+                             _mm_loadu_si128((const __m128i *) from));
+            out += 16;
+            from += 16;
+        } while (out < end);
+        return;
+    }
+
+    __m256i pattern;
+    if (distance == 1) {
+        pattern = _mm256_set1_epi8((char) *from);
+    } else {
+        // shuffles stay within 128 bit lanes, both lanes get the source
+        __m256i source = _mm256_broadcastsi128_si256(
+            _mm_loadu_si128((const __m128i *) from));
+        pattern = _mm256_shuffle_epi8(
+            source, _mm256_loadu_si256((const __m256i *)
+                                       pattern_index[distance]));
+    }
+
+    uint8_t step = pattern_step_32[distance];
+    do {
+        _mm256_storeu_si256((__m256i *) out, pattern);
+        out += step;
+    } while (out < end);
+    return;
+}
+
+__attribute__((constructor))
+static void select_copy_match(void)
+{
+    for (uint8_t distance = 1; distance < 16; ++distance) {
+        for (uint8_t i = 0; i < 32; ++i)
+            pattern_index[distance][i] = i % distance;
+        pattern_step_16[distance] = 16 - 16 % distance;
+        pattern_step_32[distance] = 32 - 32 % distance;
+    }
+
+    // the last kernel listed is the best one
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("ssse3")) {
+        match_copy_kernels[match_copy_kernel_cnt++] =
+            (struct match_copy_kernel) {"ssse3", copy_match_ssse3};
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        match_copy_kernels[match_copy_kernel_cnt++] =
+            (struct match_copy_kernel) {"avx2", copy_match_avx2};
+    }
+    copy_match = match_copy_kernels[match_copy_kernel_cnt - 1].copy;
+    return;
+}
+
+#endif
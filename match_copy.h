@@ -0,0 +1,25 @@
+#ifndef MATCH_COPY
+#define MATCH_COPY
+
+#include <inttypes.h>
+
+// match copies may write up to this many bytes past the end of the
+// match, the output buffer needs this much space after it
+#define MATCH_COPY_SLACK 32
+
+// copy length bytes starting distance bytes before out to out, the last
+// distance bytes repeat when length is more than distance. Points to the
+// best kernel the cpu supports
+extern void (*copy_match)(uint8_t *out, uint16_t distance, uint16_t length);
+
+// every kernel the cpu supports, the portable one first, so they can be
+// checked against each other
+#define MAX_MATCH_COPY_KERNELS 3
+struct match_copy_kernel {
+    const char *name;
+    void (*copy)(uint8_t *out, uint16_t distance, uint16_t length);
+};
+extern struct match_copy_kernel match_copy_kernels[MAX_MATCH_COPY_KERNELS];
+extern unsigned match_copy_kernel_cnt;
+
+#endif
@@ -0,0 +1,345 @@
+#include "parallel.h"
+#include "decompress.h"
+#include "bgzf.h"
+#include "log.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <malloc.h>
+#include <pthread.h>
+
+// the input is split into tasks of at least MIN_TASK_SIZE compressed
+// bytes, a few per thread so that threads finishing early get more work
+#define MIN_TASK_SIZE 1048576
+#define TASKS_PER_THREAD 4
+
+// BGZF tasks start at known block boundaries and can be smaller
+#define MIN_BGZF_TASK_SIZE 262144
+
+// decompressed tasks waiting to be written are limited to this many
+// per thread which bounds the memory used
+#define TASKS_IN_FLIGHT_PER_THREAD 2
+
+// member boundaries aren't known without decompressing, so a task starts
+// at a position which looks like a member header and decompresses members
+// until it reaches the start of the next task. If that position wasn't a
+// member header after all the task's output is thrown away and the
+// members are decompressed on the writing thread. BGZF tasks always start
+// at a member
+struct member_task {
+    size_t start;       // position of the first member
+    size_t end;         // members are decompressed until reaching this
+    size_t decoded_end; // position after the last decompressed member
+    bool done;
+    bool success;
+    uint8_t *out;       // decompressed data of the members
+    size_t out_len;
+};
+
+struct member_pool {
+    uint8_t *buf;
+    size_t buf_len;
+    struct decompress_options options;
+    struct member_task *tasks;
+    size_t task_cnt;
+    size_t next_task;    // next task to be picked by a worker
+    size_t written_task; // tasks before this one have been written
+    size_t max_in_flight;
+    bool stop;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+};
+
+// magic bytes and deflate compression method, no reserved flags set and
+// known XFL and OS values
+// ref: https://www.rfc-editor.org/rfc/rfc1952.txt section 2.3.1
+static bool is_member_candidate(uint8_t *buf, size_t buf_len, size_t pos)
+{
+    if (buf_len - pos < 18)
+        return false;
+
+    if (buf[pos] != 0x1f || buf[pos + 1] != 0x8b || buf[pos + 2] != 8)
+        return false;
+
+    uint8_t FLG = buf[pos + 3];
+    if (FLG & 0xe0u)
+        return false;
+
+    uint8_t XFL = buf[pos + 8];
+    if (XFL != 0 && XFL != 2 && XFL != 4)
+        return false;
+
+    uint8_t OS = buf[pos + 9];
+    if (OS > 13 && OS != 255)
+        return false;
+
+    // without optional fields the first block header follows, BTYPE 11
+    // is reserved
+    if (FLG == 0 && ((buf[pos + 10] >> 1) & 3) == 3)
+        return false;
+
+    return true;
+}
+
+static size_t find_member_candidate(uint8_t *buf, size_t buf_len, size_t pos)
+{
+    while (pos < buf_len) {
+        uint8_t *p = memchr(buf + pos, 0x1f, buf_len - pos);
+        if (p == NULL)
+            break;
+        pos = (size_t) (p - buf);
+        if (is_member_candidate(buf, buf_len, pos))
+            return pos;
+        pos++;
+    }
+
+    return buf_len;
+}
+
+static void decompress_task(struct member_pool *pool, struct member_task *task)
+{
+    task->out = NULL;
+    task->out_len = 0;
+    task->decoded_end = task->start;
+    task->success = false;
+
+    struct sink sink;
+    init_memory_sink(&sink);
+
+    size_t pos = task->start;
+    bool success = true;
+    while (pos < task->end) {
+        success = decompress_member(pool->buf, pool->buf_len, &pos, &sink,
+                                    &pool->options);
+        if (!success)
+            break;
+    }
+
+    if (!success) {
+        free(sink.buf);
+        return;
+    }
+
+    task->out = sink.buf;
+    task->out_len = sink.len;
+    task->decoded_end = pos;
+    task->success = true;
+    return;
+}
+
+static void *member_worker_run(void *arg)
+{
+    struct member_pool *pool = arg;
+
+    // tasks may start at positions which aren't members
+    quiet_errors = true;
+
+    pthread_mutex_lock(&pool->lock);
+    while (true) {
+        while (!pool->stop && pool->next_task < pool->task_cnt &&
+               pool->next_task >= pool->written_task + pool->max_in_flight)
+            pthread_cond_wait(&pool->cond, &pool->lock);
+        if (pool->stop || pool->next_task == pool->task_cnt)
+            break;
+
+        struct member_task *task = &pool->tasks[pool->next_task++];
+        pthread_mutex_unlock(&pool->lock);
+
+        decompress_task(pool, task);
+
+        pthread_mutex_lock(&pool->lock);
+        task->done = true;
+        pthread_cond_broadcast(&pool->cond);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
+
+static size_t split_tasks(uint8_t *buf, size_t buf_len, unsigned threads,
+                          struct member_task **tasks)
+{
+    size_t task_size = buf_len / ((size_t) threads * TASKS_PER_THREAD);
+    if (task_size < MIN_TASK_SIZE)
+        task_size = MIN_TASK_SIZE;
+
+    size_t max_cnt = buf_len / task_size + 1;
+    *tasks = calloc(max_cnt, sizeof(struct member_task));
+    if (*tasks == NULL)
+        return 0;
+
+    // the first member is at the start of the buffer
+    size_t cnt = 1;
+    (*tasks)[0].start = 0;
+    for (size_t split = task_size; split < buf_len && cnt < max_cnt;
+         split += task_size) {
+        size_t from = split > (*tasks)[cnt - 1].start ? split :
+            (*tasks)[cnt - 1].start + 1;
+        size_t start = find_member_candidate(buf, buf_len, from);
+        if (start == buf_len)
+            break;
+        (*tasks)[cnt++].start = start;
+    }
+
+    for (size_t i = 0; i < cnt; ++i)
+        (*tasks)[i].end = i + 1 < cnt ? (*tasks)[i + 1].start : buf_len;
+
+    return cnt;
+}
+
+// return 0 if the buffer isn't made of BGZF blocks only
+static size_t split_bgzf_tasks(uint8_t *buf, size_t buf_len, unsigned threads,
+                               struct member_task **tasks)
+{
+    size_t task_size = buf_len / ((size_t) threads * TASKS_PER_THREAD);
+    if (task_size < MIN_BGZF_TASK_SIZE)
+        task_size = MIN_BGZF_TASK_SIZE;
+
+    size_t block_size;
+    if (!bgzf_block_size(buf, buf_len, 0, &block_size))
+        return 0;
+
+    // every task but the last one is at least task_size long
+    size_t max_cnt = buf_len / task_size + 1;
+    *tasks = calloc(max_cnt, sizeof(struct member_task));
+    if (*tasks == NULL)
+        return 0;
+
+    size_t cnt = 1;
+    size_t pos = 0;
+    size_t last_block = 0;
+    (*tasks)[0].start = 0;
+    while (pos < buf_len) {
+        if (!bgzf_block_size(buf, buf_len, pos, &block_size)) {
+            free(*tasks);
+            *tasks = NULL;
+            return 0;
+        }
+        if (pos - (*tasks)[cnt - 1].start >= task_size && cnt < max_cnt)
+            (*tasks)[cnt++].start = pos;
+        last_block = pos;
+        pos += block_size;
+    }
+
+    // the file is fine without it but a missing EOF block usually means
+    // the file got truncated at a block boundary
+    if (!is_bgzf_eof_block(buf, buf_len, last_block))
+        log_error("Warning: BGZF EOF block is missing, the file may be "
+                  "truncated\n");
+
+    for (size_t i = 0; i < cnt; ++i)
+        (*tasks)[i].end = i + 1 < cnt ? (*tasks)[i + 1].start : buf_len;
+
+    return cnt;
+}
+
+bool decompress_members_parallel(uint8_t *buf, size_t buf_len,
+                                 struct sink *sink,
+                                 struct decompress_options *options)
+{
+    struct decompress_options sequential = *options;
+    sequential.threads = 1;
+
+    struct member_pool pool;
+    pool.task_cnt = split_bgzf_tasks(buf, buf_len, options->threads,
+                                     &pool.tasks);
+    if (pool.task_cnt == 0)
+        pool.task_cnt = split_tasks(buf, buf_len, options->threads,
+                                    &pool.tasks);
+    if (pool.task_cnt <= 1) {
+        // a single large member is decompressed on the threads instead
+        free(pool.tasks);
+        size_t pos = 0;
+        do {
+            if (!decompress_member(buf, buf_len, &pos, sink, options))
+                return false;
+        } while (pos < buf_len);
+        return true;
+    }
+
+    pool.buf = buf;
+    pool.buf_len = buf_len;
+    pool.options = sequential;
+    pool.options.crc_thread = false;
+    pool.next_task = 0;
+    pool.written_task = 0;
+    pool.max_in_flight = (size_t) options->threads * TASKS_IN_FLIGHT_PER_THREAD;
+    pool.stop = false;
+
+    if (pthread_mutex_init(&pool.lock, NULL) != 0) {
+        free(pool.tasks);
+        return false;
+    }
+    if (pthread_cond_init(&pool.cond, NULL) != 0) {
+        pthread_mutex_destroy(&pool.lock);
+        free(pool.tasks);
+        return false;
+    }
+
+    unsigned thread_cnt = options->threads;
+    if (thread_cnt > pool.task_cnt)
+        thread_cnt = (unsigned) pool.task_cnt;
+
+    pthread_t *threads = malloc(thread_cnt * sizeof(pthread_t));
+    unsigned started = 0;
+    if (threads != NULL) {
+        for (; started < thread_cnt; ++started) {
+            if (pthread_create(&threads[started], NULL, member_worker_run,
+                               &pool) != 0)
+                break;
+        }
+    }
+
+    // with no workers every task is decompressed on this thread
+    size_t pos = 0;
+    bool success = true;
+    for (size_t i = 0; i < pool.task_cnt && success; ++i) {
+        struct member_task *task = &pool.tasks[i];
+
+        // workers pick every task before it's this one's turn to be written
+        pthread_mutex_lock(&pool.lock);
+        while (started > 0 && !task->done)
+            pthread_cond_wait(&pool.cond, &pool.lock);
+        pthread_mutex_unlock(&pool.lock);
+
+        if (pos >= task->end) {
+            // members of an earlier task already covered this one
+        } else if (task->done && task->success && task->start == pos) {
+            success = write_sink(sink, task->out, task->out_len);
+            pos = task->decoded_end;
+        } else {
+            // not a member start or failed to decompress, the errors of
+            // actually broken members get reported from here
+            while (pos < task->end && success)
+                success = decompress_member(buf, buf_len, &pos, sink,
+                                            &sequential);
+        }
+
+        free(task->out);
+        task->out = NULL;
+
+        pthread_mutex_lock(&pool.lock);
+        pool.written_task = i + 1;
+        pthread_cond_broadcast(&pool.cond);
+        pthread_mutex_unlock(&pool.lock);
+    }
+
+    pthread_mutex_lock(&pool.lock);
+    pool.stop = true;
+    pthread_cond_broadcast(&pool.cond);
+    pthread_mutex_unlock(&pool.lock);
+
+    for (unsigned i = 0; i < started; ++i)
+        pthread_join(threads[i], NULL);
+
+    for (size_t i = 0; i < pool.task_cnt; ++i)
+        free(pool.tasks[i].out);
+
+    free(threads);
+    free(pool.tasks);
+    pthread_cond_destroy(&pool.cond);
+    pthread_mutex_destroy(&pool.lock);
+    return success;
+}
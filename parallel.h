@@ -0,0 +1,15 @@
+#ifndef PARALLEL
+#define PARALLEL
+
+#include "decompress.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+// decompresses members on options->threads threads, output is written
+// in order
+bool decompress_members_parallel(uint8_t *buf, size_t buf_len,
+                                 struct sink *sink,
+                                 struct decompress_options *options);
+
+#endif
@@ -0,0 +1,220 @@
+// fallocate
+#define _GNU_SOURCE
+
+#include "sink.h"
+#include "log.h"
+
+#include <string.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <malloc.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+
+// pieces written with one writev, callers pass a handful
+#define SINK_IOV_MAX 16
+
+static bool write_fd(void *arg, const uint8_t *buf, size_t len)
+{
+    struct sink *sink = arg;
+    while (len > 0) {
+        ssize_t cnt = write(sink->fd, buf, len);
+        if (cnt == -1) {
+            if (errno == EINTR)
+                continue;
+            log_error("Could not write full buffer\n");
+            return false;
+        }
+        buf += cnt;
+        len -= (size_t) cnt;
+    }
+
+    return true;
+}
+
+// partial writes continue from the first piece that wasn't written fully
+static bool writev_fd(void *arg, const struct iovec *iov, int cnt)
+{
+    struct sink *sink = arg;
+    struct iovec rest[SINK_IOV_MAX];
+    if (cnt > SINK_IOV_MAX)
+        return false;
+    memcpy(rest, iov, cnt * sizeof(struct iovec));
+
+    struct iovec *next = rest;
+    while (cnt > 0) {
+        ssize_t n = writev(sink->fd, next, cnt);
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+            log_error("Could not write full buffer\n");
+            return false;
+        }
+        size_t written = (size_t) n;
+        while (cnt > 0 && written >= next->iov_len) {
+            written -= next->iov_len;
+            next++;
+            cnt--;
+        }
+        if (cnt > 0) {
+            next->iov_base = (uint8_t *) next->iov_base + written;
+            next->iov_len -= written;
+        }
+    }
+
+    return true;
+}
+
+static bool write_memory(void *arg, const uint8_t *buf, size_t len)
+{
+    struct sink *sink = arg;
+    if (sink->size - sink->len < len) {
+        size_t size = sink->size ? sink->size : 65536;
+        while (size - sink->len < len) {
+            if (size > SIZE_MAX / 2)
+                return false;
+            size *= 2;
+        }
+        uint8_t *tmp = realloc(sink->buf, size);
+        if (tmp == NULL) {
+            log_error("Failed to allocate output buffer\n");
+            return false;
+        }
+        sink->buf = tmp;
+        sink->size = size;
+    }
+
+    memcpy(sink->buf + sink->len, buf, len);
+    sink->len += len;
+    return true;
+}
+
+// unmaps the file and truncates it to the output written, the sink
+// writes to fd from then on
+static bool unmap_sink(void *arg)
+{
+    struct sink *sink = arg;
+    if (!sink->mapped)
+        return true;
+
+    bool success = munmap(sink->buf, sink->size) == 0 &&
+        ftruncate(sink->fd, (off_t) sink->len) == 0 &&
+        lseek(sink->fd, (off_t) sink->len, SEEK_SET) != -1;
+    if (!success)
+        log_error("Failed to unmap output file\n");
+
+    sink->write = write_fd;
+    sink->writev = writev_fd;
+    sink->finish = NULL;
+    sink->buf = NULL;
+    sink->size = 0;
+    sink->mapped = false;
+    return success;
+}
+
+// the rest of the output goes to fd once it doesn't fit the mapping
+static bool write_map(void *arg, const uint8_t *buf, size_t len)
+{
+    struct sink *sink = arg;
+    if (sink->size - sink->len < len)
+        return unmap_sink(sink) && write_fd(sink, buf, len);
+
+    memcpy(sink->buf + sink->len, buf, len);
+    sink->len += len;
+    return true;
+}
+
+static bool write_discard(void *arg, const uint8_t *buf, size_t len)
+{
+    (void) arg;
+    (void) buf;
+    (void) len;
+    return true;
+}
+
+static void init_sink(struct sink *sink, sink_write_fn write, void *arg)
+{
+    sink->write = write;
+    sink->writev = NULL;
+    sink->finish = NULL;
+    sink->arg = arg;
+    sink->fd = -1;
+    sink->buf = NULL;
+    sink->len = 0;
+    sink->size = 0;
+    sink->mapped = false;
+    return;
+}
+
+void init_fd_sink(struct sink *sink, int fd)
+{
+    init_sink(sink, write_fd, sink);
+    sink->writev = writev_fd;
+    sink->fd = fd;
+    return;
+}
+
+void init_memory_sink(struct sink *sink)
+{
+    init_sink(sink, write_memory, sink);
+    return;
+}
+
+void init_discard_sink(struct sink *sink)
+{
+    init_sink(sink, write_discard, sink);
+    return;
+}
+
+void init_callback_sink(struct sink *sink, sink_write_fn write, void *arg)
+{
+    init_sink(sink, write, arg);
+    return;
+}
+
+bool write_sink_vector(struct sink *sink, const struct iovec *iov, int cnt)
+{
+    if (sink->writev != NULL && cnt <= SINK_IOV_MAX)
+        return sink->writev(sink->arg, iov, cnt);
+
+    for (int i = 0; i < cnt; ++i) {
+        if (!write_sink(sink, iov[i].iov_base, iov[i].iov_len))
+            return false;
+    }
+
+    return true;
+}
+
+bool init_map_sink(struct sink *sink, int fd, size_t size)
+{
+    // filesystems without fallocate get a sparse file instead
+    if (size == 0 || (fallocate(fd, 0, 0, (off_t) size) != 0 &&
+                      ftruncate(fd, (off_t) size) != 0))
+        return false;
+
+    uint8_t *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+                        0);
+    if (map == MAP_FAILED) {
+        if (ftruncate(fd, 0) != 0)
+            log_error("Failed to truncate output file\n");
+        return false;
+    }
+    madvise(map, size, MADV_SEQUENTIAL);
+
+    init_sink(sink, write_map, sink);
+    sink->finish = unmap_sink;
+    sink->fd = fd;
+    sink->buf = map;
+    sink->size = size;
+    sink->mapped = true;
+    return true;
+}
+
+bool finish_sink(struct sink *sink)
+{
+    return sink->finish == NULL || sink->finish(sink->arg);
+}
@@ -0,0 +1,76 @@
+#ifndef SINK
+#define SINK
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/uio.h>
+
+// decompressed output is handed to a sink a piece at a time. buf points
+// into the decoder's own buffers and is only valid during the call, so a
+// sink which hashes or scans the output sees it without another copy.
+// A write returns false to stop decompressing
+typedef bool (*sink_write_fn)(void *arg, const uint8_t *buf, size_t len);
+
+// writes several pieces of output in order with one call, like writev(2)
+typedef bool (*sink_writev_fn)(void *arg, const struct iovec *iov, int cnt);
+
+// writes output the sink still holds and releases what it allocated
+typedef bool (*sink_finish_fn)(void *arg);
+
+struct sink {
+    sink_write_fn write;
+    sink_writev_fn writev; // NULL if pieces are written one at a time
+    sink_finish_fn finish; // NULL if there is nothing to finish
+    void *arg;
+    int fd;         // file descriptor of an fd or map sink
+    uint8_t *buf;   // output collected by a memory sink or mapped file
+    size_t len;
+    size_t size;    // allocated or mapped bytes of buf
+    bool mapped;
+};
+
+// writes to fd, which is left open
+void init_fd_sink(struct sink *sink, int fd);
+
+// collects the output in buf, which the caller frees or takes over
+void init_memory_sink(struct sink *sink);
+
+// drops the output, for decoding only to check or index it
+void init_discard_sink(struct sink *sink);
+
+void init_callback_sink(struct sink *sink, sink_write_fn write, void *arg);
+
+// writes to fd through a shared mapping of the file, which is first
+// preallocated to size bytes. Output past size is written to fd like an
+// fd sink, returns false if the file can't be mapped. Finishing unmaps
+// the file and truncates it to the output written
+bool init_map_sink(struct sink *sink, int fd, size_t size);
+
+// called once all of the output was written, returns false if some of
+// it couldn't be. The fd of fd and map sinks is left open
+bool finish_sink(struct sink *sink);
+
+// output can be decoded in place into the room after buf + len of a map
+// sink and added with sink_commit without another copy. Other sinks
+// have no room
+static inline size_t sink_room(struct sink *sink)
+{
+    return sink->mapped ? sink->size - sink->len : 0;
+}
+
+static inline void sink_commit(struct sink *sink, size_t len)
+{
+    sink->len += len;
+    return;
+}
+
+static inline bool write_sink(struct sink *sink, const uint8_t *buf,
+                              size_t len)
+{
+    return len == 0 || sink->write(sink->arg, buf, len);
+}
+
+bool write_sink_vector(struct sink *sink, const struct iovec *iov, int cnt);
+
+#endif
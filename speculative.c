@@ -0,0 +1,719 @@
+#include "speculative.h"
+#include "decompress.h"
+#include "deflate.h"
+#include "bit_reader.h"
+#include "huffman_table.h"
+#include "crc32.h"
+#include "log.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <malloc.h>
+#include <pthread.h>
+
+// decoded chunks waiting to be written are limited to this many per
+// thread which bounds the memory used
+#define CHUNKS_IN_FLIGHT_PER_THREAD 2
+
+// a chunk is decoded before the output preceding it is known, so back
+// references into the 32768 bytes before the chunk are decoded as marker
+// symbols MARKER_BASE + position in that window. Literals are symbols
+// below 256, all other symbols are markers
+#define MARKER_BASE 0x8000u
+
+// symbols decoded before markers have to be gone from the last 32768
+// symbols. A candidate which decodes this many is taken to be a block
+// start, its chunk ends after the last whole block and the rest of it is
+// decoded on the writing thread
+#define MARKER_BUF_SIZE 1048576
+#define MAX_MARKER_SYMBOLS 16777216
+
+// the candidates of a chunk that fail may decode this many symbols in
+// total before the writing thread is left to decode the chunk
+#define MAX_SEARCH_SYMBOLS 16777216
+
+// the compressed input is split into chunks and each chunk is decoded by
+// a worker starting at the first position after its start that looks like
+// the start of a block. A chunk is decoded until the next block would
+// start in the next chunk, so if that chunk started at a real block the
+// two chunks line up. Otherwise the writing thread decodes the chunk
+// again starting where the previous one stopped
+// ref: https://arxiv.org/abs/2308.08955 (rapidgzip)
+struct chunk {
+    uint64_t search_bit; // first input bit searched for a block start
+    uint64_t stop_bit;   // decoding stops before a block starting here or later
+    uint64_t start_bit;  // start of the first decoded block
+    uint64_t start_last; // last bit the first block could start at
+    uint64_t end_bit;    // where decoding stopped
+    bool final;          // the final block was decoded
+    bool done;
+    bool success;
+    uint16_t *symbols;   // MAX_DISTANCE markers followed by decoded symbols
+    size_t symbol_cnt;   // decoded symbols after the markers
+    uint16_t min_marker; // earliest window position referenced
+    uint8_t *out;        // output decoded after markers were gone
+    size_t out_len;
+};
+
+struct chunk_pool {
+    uint8_t *buf;
+    size_t buf_len;
+    struct chunk *chunks;
+    size_t chunk_cnt;
+    size_t next_chunk;    // next chunk to be picked by a worker
+    size_t written_chunk; // chunks before this one have been written
+    size_t max_in_flight;
+    bool stop;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+};
+
+// decoding state of a chunk while its window is unknown
+struct marker_data {
+    struct bit_reader in;
+    uint16_t *buf;       // MAX_DISTANCE markers followed by decoded symbols
+    size_t pos;          // next position in buf
+    size_t size;         // allocated symbols of buf
+    size_t marker_end;   // symbols from here on are literals
+    uint16_t min_marker; // earliest window position referenced
+    bool full;           // MAX_MARKER_SYMBOLS were decoded
+    size_t stop_pos;     // decoding stops once pos gets here
+};
+
+// only blocks with a header which can be checked are searched for,
+// a block type 00 with LEN matching NLEN and a block type 10 whose code
+// length code lengths form a complete code
+// ref: https://www.rfc-editor.org/rfc/rfc1951.txt section 3.2.7
+static bool is_block_candidate(uint8_t *buf, size_t buf_len, uint64_t bit)
+{
+    size_t pos = (size_t) (bit / 8);
+    if (buf_len - pos < 16)
+        return false;
+
+    uint64_t word = load_le64(buf + pos) >> (bit % 8);
+
+    // BFINAL 0 and BTYPE 00, padding to the byte boundary is zero
+    if ((word & 7) == 0) {
+        uint8_t pad = (uint8_t) ((8 - (bit + 3) % 8) % 8);
+        if ((word >> 3) & ((1u << pad) - 1))
+            return false;
+        size_t len_pos = (size_t) ((bit + 3 + pad) / 8);
+        if (buf_len - len_pos < 4)
+            return false;
+        uint16_t LEN = buf[len_pos] + 256 * buf[len_pos + 1];
+        uint16_t NLEN = buf[len_pos + 2] + 256 * buf[len_pos + 3];
+        return LEN == (uint16_t) ~NLEN && buf_len - len_pos - 4 >= LEN;
+    }
+
+    // BFINAL 0 and BTYPE 10, at most 286 ll codes and 30 distance codes
+    if ((word & 7) != 4)
+        return false;
+    if (((word >> 3) & 31) > 29 || ((word >> 8) & 31) > 29)
+        return false;
+
+    uint8_t cl_code_cnt = (uint8_t) ((word >> 13) & 15) + 4;
+    uint64_t cl_bit = bit + 17;
+    uint64_t cl_word = load_le64(buf + cl_bit / 8) >> (cl_bit % 8);
+    uint32_t kraft = 0;
+    for (uint8_t i = 0; i < cl_code_cnt; ++i) {
+        uint8_t len = (uint8_t) ((cl_word >> (3 * i)) & 7);
+        if (len)
+            kraft += 1u << (7 - len);
+    }
+
+    return kraft == 128;
+}
+
+static bool reserve_symbols(struct marker_data *data, size_t cnt)
+{
+    if (data->size - data->pos >= cnt)
+        return true;
+
+    size_t size = data->size * 2;
+    if (size > MAX_DISTANCE + MAX_MARKER_SYMBOLS) {
+        data->full = true;
+        return false;
+    }
+
+    uint16_t *buf = realloc(data->buf, size * sizeof(uint16_t));
+    if (buf == NULL)
+        return false;
+
+    data->buf = buf;
+    data->size = size;
+    return true;
+}
+
+static bool decode_marker_block_type_00(struct marker_data *data)
+{
+    struct bit_reader *in = &data->in;
+    align_to_byte(in);
+    if (bit_reader_overrun(in))
+        return false;
+
+    size_t pos = bit_reader_byte_position(in);
+    if (pos >= in->buf_len || in->buf_len - pos < 4)
+        return false;
+
+    uint16_t LEN = in->buf[pos] + 256 * in->buf[pos + 1];
+    uint16_t NLEN = in->buf[pos + 2] + 256 * in->buf[pos + 3];
+    pos += 4;
+
+    if (LEN != (uint16_t) (~NLEN) || in->buf_len - pos < LEN)
+        return false;
+
+    if (!reserve_symbols(data, LEN))
+        return false;
+
+    for (uint16_t i = 0; i < LEN; ++i)
+        data->buf[data->pos++] = in->buf[pos + i];
+
+    bit_reader_seek(in, pos + LEN);
+    return true;
+}
+
+// copies of symbols from the window keep them as markers, so marker_end
+// moves with every copy that includes one
+static bool decode_marker_huffman_block(struct marker_data *data,
+                                        const struct huffman_table *ll_table,
+                                        const struct huffman_table *d_table)
+{
+    struct bit_reader *in = &data->in;
+
+    while (data->pos < data->stop_pos) {
+        if (!reserve_symbols(data, 258))
+            return false;
+
+        refill_bits(in);
+
+        uint16_t code = 0;
+        if (!decode_symbol(in, ll_table, &code))
+            return false;
+
+        if (is_literal_code(code) || code == 256) {
+            if (bit_reader_overrun(in))
+                return false;
+            if (code == 256)
+                break;
+            data->buf[data->pos++] = code;
+            continue;
+        }
+
+        uint16_t length = 0;
+        if (!length_from_length_code(in, code, &length))
+            return false;
+
+        uint16_t distance_code = 0;
+        if (!decode_symbol(in, d_table, &distance_code))
+            return false;
+
+        uint16_t distance = 0;
+        if (!distance_from_distance_code(in, (uint8_t) distance_code,
+                                         &distance))
+            return false;
+
+        if (bit_reader_overrun(in))
+            return false;
+
+        // buf starts with MAX_DISTANCE markers so every distance is valid
+        uint16_t *out = data->buf + data->pos;
+        const uint16_t *from = out - distance;
+        if (from < data->buf + MAX_DISTANCE &&
+            from - data->buf < data->min_marker)
+            data->min_marker = (uint16_t) (from - data->buf);
+
+        uint16_t seen = 0;
+        for (uint16_t i = 0; i < length; ++i) {
+            out[i] = from[i];
+            seen |= from[i];
+        }
+        data->pos += length;
+        if (seen & MARKER_BASE)
+            data->marker_end = data->pos;
+    }
+
+    return true;
+}
+
+static bool markers_gone(const struct marker_data *data)
+{
+    return data->pos - data->marker_end >= MAX_DISTANCE;
+}
+
+// decodes blocks until the last MAX_DISTANCE symbols are literals, until
+// the final block or until the next block would start at or after stop_bit.
+// A block that doesn't fit in MAX_MARKER_SYMBOLS is left undecoded if one
+// before it was decoded, markers may be left then
+static bool decode_marker_blocks(struct marker_data *data, uint64_t stop_bit,
+                                 bool *final)
+{
+    *final = false;
+
+    bool decoded = false;
+    while (bit_reader_bit_position(&data->in) < stop_bit &&
+           data->pos < data->stop_pos && !markers_gone(data)) {
+        uint64_t block_bit = bit_reader_bit_position(&data->in);
+        size_t block_pos = data->pos;
+        size_t block_marker_end = data->marker_end;
+        uint16_t block_min_marker = data->min_marker;
+
+        uint16_t header = 0;
+        if (!read_bits(&data->in, 3, &header))
+            return false;
+
+        bool BFINAL = header & 1;
+        uint8_t BTYPE = (uint8_t) (header >> 1);
+
+        bool success = false;
+        if (BTYPE == 0) {
+            success = decode_marker_block_type_00(data);
+        } else if (BTYPE == 1) {
+            success = decode_marker_huffman_block(data, &fixed_ll_table,
+                                                  &fixed_d_table);
+        } else if (BTYPE == 2) {
+            struct huffman_table ll_table;
+            struct huffman_table d_table;
+            struct huffman_entry ll_entries[LL_TABLE_ENTRIES];
+            struct huffman_entry d_entries[D_TABLE_ENTRIES];
+            if (!read_dynamic_tables(&data->in, 0, false, &ll_table,
+                                     ll_entries, &d_table, d_entries))
+                return false;
+            success = decode_marker_huffman_block(data, &ll_table, &d_table);
+        }
+        if (!success && data->full && decoded) {
+            data->pos = block_pos;
+            data->marker_end = block_marker_end;
+            data->min_marker = block_min_marker;
+            bit_reader_init_at_bit(&data->in, data->in.buf, data->in.buf_len,
+                                   block_bit);
+            break;
+        }
+        if (!success)
+            return false;
+        decoded = true;
+
+        if (BFINAL) {
+            *final = true;
+            break;
+        }
+    }
+
+    return true;
+}
+
+// the markers at the front of buf are never overwritten, so buf can be
+// used again for another start_marker_data
+static bool alloc_marker_data(struct marker_data *data, size_t size)
+{
+    data->size = size;
+    data->buf = malloc(data->size * sizeof(uint16_t));
+    if (data->buf == NULL)
+        return false;
+    for (size_t i = 0; i < MAX_DISTANCE; ++i)
+        data->buf[i] = (uint16_t) (MARKER_BASE + i);
+    return true;
+}
+
+static void start_marker_data(struct marker_data *data, uint8_t *buf,
+                              size_t buf_len, uint64_t start_bit)
+{
+    data->pos = MAX_DISTANCE;
+    data->marker_end = MAX_DISTANCE;
+    data->min_marker = MAX_DISTANCE;
+    data->full = false;
+    data->stop_pos = SIZE_MAX;
+    bit_reader_init_at_bit(&data->in, buf, buf_len, start_bit);
+    return;
+}
+
+// decodes blocks with markers while the window is unknown, then decodes
+// the rest of the chunk with the regular decoder once it isn't. The chunk
+// takes data->buf on success
+static bool decode_chunk_from(struct chunk_pool *pool, struct chunk *chunk,
+                              struct marker_data *data, uint64_t start_bit)
+{
+    start_marker_data(data, pool->buf, pool->buf_len, start_bit);
+
+    bool final = false;
+    if (!decode_marker_blocks(data, chunk->stop_bit, &final))
+        return false;
+
+    uint64_t bit = bit_reader_bit_position(&data->in);
+    uint8_t *out = NULL;
+    size_t out_len = 0;
+    if (!final && bit < chunk->stop_bit && markers_gone(data)) {
+        // the last MAX_DISTANCE symbols are all literals
+        uint8_t *window = malloc(MAX_DISTANCE);
+        if (window == NULL)
+            return false;
+        for (size_t i = 0; i < MAX_DISTANCE; ++i)
+            window[i] = (uint8_t) data->buf[data->pos - MAX_DISTANCE + i];
+
+        struct sink sink;
+        init_memory_sink(&sink);
+
+        uint32_t crc = 0;
+        uint64_t size = 0;
+        bool success = decompress_blocks_at(pool->buf, pool->buf_len, &bit,
+                                            chunk->stop_bit, window,
+                                            MAX_DISTANCE, &sink, &final,
+                                            &crc, &size);
+        free(window);
+        if (!success) {
+            free(sink.buf);
+            return false;
+        }
+        out = sink.buf;
+        out_len = sink.len;
+    }
+
+    // zero bits before a block type 00 header read as the header and
+    // padding as well, so it could have started at any bit up to its last
+    // possible header position
+    size_t byte = (size_t) (start_bit / 8);
+    uint32_t header = (pool->buf[byte] | pool->buf[byte + 1] << 8) >>
+        (start_bit % 8);
+    chunk->start_bit = start_bit;
+    chunk->start_last = start_bit;
+    if ((header & 7) == 0)
+        chunk->start_last = (start_bit + 3 + 7) / 8 * 8 - 3;
+    chunk->end_bit = bit;
+    chunk->final = final;
+    chunk->symbols = data->buf;
+    chunk->symbol_cnt = data->pos - MAX_DISTANCE;
+    chunk->min_marker = data->min_marker;
+    chunk->out = out;
+    chunk->out_len = out_len;
+    data->buf = NULL;
+    return true;
+}
+
+// the first chunk starts at the first block of the member, the others
+// at the first candidate which decodes until the end of the chunk. The
+// search gives up once the candidates that failed decoded
+// MAX_SEARCH_SYMBOLS, data->buf is kept for the next chunk
+static void decode_chunk(struct chunk_pool *pool, struct chunk *chunk,
+                         bool first, struct marker_data *data)
+{
+    chunk->success = false;
+    chunk->symbols = NULL;
+    chunk->out = NULL;
+
+    if (data->buf == NULL && !alloc_marker_data(data, MARKER_BUF_SIZE))
+        return;
+
+    if (first) {
+        chunk->success = decode_chunk_from(pool, chunk, data,
+                                           chunk->search_bit);
+        return;
+    }
+
+    uint64_t search_end = (uint64_t) pool->buf_len * 8;
+    if (search_end > chunk->stop_bit)
+        search_end = chunk->stop_bit;
+
+    size_t searched = 0;
+    for (uint64_t bit = chunk->search_bit;
+         bit < search_end && searched < MAX_SEARCH_SYMBOLS; ++bit) {
+        if (!is_block_candidate(pool->buf, pool->buf_len, bit))
+            continue;
+        if (decode_chunk_from(pool, chunk, data, bit)) {
+            chunk->success = true;
+            return;
+        }
+        searched += data->pos - MAX_DISTANCE;
+    }
+
+    return;
+}
+
+// only back references of the first MAX_DISTANCE bytes after the block
+// can reach into the window, markers further on are copies of those
+bool find_window_references(uint8_t *buf, size_t buf_len, uint64_t bit_pos,
+                            bool *used)
+{
+    struct marker_data data;
+    if (!alloc_marker_data(&data, 4 * MAX_DISTANCE))
+        return false;
+    start_marker_data(&data, buf, buf_len, bit_pos);
+    data.stop_pos = 2 * MAX_DISTANCE;
+
+    bool final = false;
+    if (!decode_marker_blocks(&data, UINT64_MAX, &final)) {
+        free(data.buf);
+        return false;
+    }
+
+    memset(used, 0, MAX_DISTANCE * sizeof(bool));
+    for (size_t i = MAX_DISTANCE; i < data.pos; ++i) {
+        if (data.buf[i] & MARKER_BASE)
+            used[data.buf[i] - MARKER_BASE] = true;
+    }
+
+    free(data.buf);
+    return true;
+}
+
+static void *chunk_worker_run(void *arg)
+{
+    struct chunk_pool *pool = arg;
+
+    // chunks may start at positions which aren't blocks
+    quiet_errors = true;
+
+    // the marker buffer is used for all candidates until a chunk takes it
+    struct marker_data data;
+    data.buf = NULL;
+
+    pthread_mutex_lock(&pool->lock);
+    while (true) {
+        while (!pool->stop && pool->next_chunk < pool->chunk_cnt &&
+               pool->next_chunk >= pool->written_chunk + pool->max_in_flight)
+            pthread_cond_wait(&pool->cond, &pool->lock);
+        if (pool->stop || pool->next_chunk == pool->chunk_cnt)
+            break;
+
+        size_t i = pool->next_chunk++;
+        struct chunk *chunk = &pool->chunks[i];
+        pthread_mutex_unlock(&pool->lock);
+
+        decode_chunk(pool, chunk, i == 0, &data);
+
+        pthread_mutex_lock(&pool->lock);
+        chunk->done = true;
+        pthread_cond_broadcast(&pool->cond);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    free(data.buf);
+    return NULL;
+}
+
+// output written so far, the last MAX_DISTANCE bytes of it are kept at
+// the end of window
+struct chunk_output {
+    struct sink *sink;
+    uint32_t crc;
+    uint64_t size;
+    uint8_t window[MAX_DISTANCE];
+    size_t window_len;
+};
+
+// adds output about to be written to crc, size and window
+static void add_output(struct chunk_output *output, const uint8_t *buf,
+                       size_t len)
+{
+    if (len == 0)
+        return;
+
+    output->crc = crc32_update(output->crc, buf, len);
+    output->size += len;
+
+    if (len >= MAX_DISTANCE) {
+        memcpy(output->window, buf + len - MAX_DISTANCE, MAX_DISTANCE);
+        output->window_len = MAX_DISTANCE;
+    } else {
+        memmove(output->window, output->window + len, MAX_DISTANCE - len);
+        memcpy(output->window + MAX_DISTANCE - len, buf, len);
+        output->window_len += len;
+        if (output->window_len > MAX_DISTANCE)
+            output->window_len = MAX_DISTANCE;
+    }
+
+    return;
+}
+
+static bool write_output(struct chunk_output *output, const uint8_t *buf,
+                         size_t len)
+{
+    add_output(output, buf, len);
+    return write_sink(output->sink, buf, len);
+}
+
+// markers are replaced by the bytes of the window they stand for
+static bool write_chunk(struct chunk_output *output, struct chunk *chunk)
+{
+    const uint16_t *symbols = chunk->symbols + MAX_DISTANCE;
+    uint8_t *bytes = malloc(chunk->symbol_cnt ? chunk->symbol_cnt : 1);
+    if (bytes == NULL)
+        return false;
+
+    for (size_t i = 0; i < chunk->symbol_cnt; ++i) {
+        uint16_t symbol = symbols[i];
+        bytes[i] = symbol & MARKER_BASE ? output->window[symbol - MARKER_BASE] :
+            (uint8_t) symbol;
+    }
+
+    // both parts go out with one write
+    add_output(output, bytes, chunk->symbol_cnt);
+    add_output(output, chunk->out, chunk->out_len);
+    struct iovec iov[2] = {{bytes, chunk->symbol_cnt},
+                           {chunk->out, chunk->out_len}};
+    bool success = write_sink_vector(output->sink, iov, 2);
+    free(bytes);
+    return success;
+}
+
+// a sink_write for passing output decoded again straight to write_output
+static bool write_output_sink(void *arg, const uint8_t *buf, size_t len)
+{
+    return write_output(arg, buf, len);
+}
+
+// decodes from *bit with the known window until the chunk's stop_bit
+static bool decode_chunk_again(struct chunk_pool *pool,
+                               struct chunk_output *output,
+                               struct chunk *chunk, uint64_t *bit,
+                               bool *final)
+{
+    // the window is copied before decoding starts, so write_output can
+    // update it as the output comes in
+    struct sink sink;
+    init_callback_sink(&sink, write_output_sink, output);
+
+    uint32_t crc = 0;
+    uint64_t size = 0;
+    return decompress_blocks_at(pool->buf, pool->buf_len, bit,
+                                chunk->stop_bit,
+                                output->window + MAX_DISTANCE -
+                                output->window_len,
+                                output->window_len, &sink, final, &crc, &size);
+}
+
+static void free_chunk(struct chunk *chunk)
+{
+    free(chunk->symbols);
+    free(chunk->out);
+    chunk->symbols = NULL;
+    chunk->out = NULL;
+    return;
+}
+
+bool decompress_blocks_parallel(uint8_t *buf, size_t buf_len, size_t *buf_pos,
+                                struct sink *sink,
+                                struct decompress_options *options,
+                                uint32_t *crc, uint64_t *size)
+{
+    struct chunk_pool pool;
+    pool.buf = buf;
+    pool.buf_len = buf_len;
+    pool.chunk_cnt = (buf_len - *buf_pos + SPECULATIVE_CHUNK_SIZE - 1) /
+        SPECULATIVE_CHUNK_SIZE;
+    pool.chunks = calloc(pool.chunk_cnt, sizeof(struct chunk));
+    if (pool.chunks == NULL) {
+        log_error("Failed to allocate chunks\n");
+        return false;
+    }
+
+    for (size_t i = 0; i < pool.chunk_cnt; ++i) {
+        pool.chunks[i].search_bit =
+            ((uint64_t) *buf_pos + i * SPECULATIVE_CHUNK_SIZE) * 8;
+        pool.chunks[i].stop_bit = i + 1 < pool.chunk_cnt ?
+            ((uint64_t) *buf_pos + (i + 1) * SPECULATIVE_CHUNK_SIZE) * 8 :
+            UINT64_MAX;
+    }
+
+    pool.next_chunk = 0;
+    pool.written_chunk = 0;
+    pool.max_in_flight = (size_t) options->threads *
+        CHUNKS_IN_FLIGHT_PER_THREAD;
+    pool.stop = false;
+
+    if (pthread_mutex_init(&pool.lock, NULL) != 0) {
+        free(pool.chunks);
+        return false;
+    }
+    if (pthread_cond_init(&pool.cond, NULL) != 0) {
+        pthread_mutex_destroy(&pool.lock);
+        free(pool.chunks);
+        return false;
+    }
+
+    unsigned thread_cnt = options->threads;
+    if (thread_cnt > pool.chunk_cnt)
+        thread_cnt = (unsigned) pool.chunk_cnt;
+
+    pthread_t *threads = malloc(thread_cnt * sizeof(pthread_t));
+    unsigned started = 0;
+    if (threads != NULL) {
+        for (; started < thread_cnt; ++started) {
+            if (pthread_create(&threads[started], NULL, chunk_worker_run,
+                               &pool) != 0)
+                break;
+        }
+    }
+
+    struct chunk_output *output = malloc(sizeof(struct chunk_output));
+    bool success = output != NULL;
+    if (success) {
+        output->sink = sink;
+        output->crc = 0;
+        output->size = 0;
+        output->window_len = 0;
+    }
+
+    // with no workers every chunk is decoded on this thread
+    uint64_t bit = (uint64_t) *buf_pos * 8;
+    bool final = false;
+    for (size_t i = 0; i < pool.chunk_cnt && success && !final; ++i) {
+        struct chunk *chunk = &pool.chunks[i];
+
+        pthread_mutex_lock(&pool.lock);
+        while (started > 0 && !chunk->done)
+            pthread_cond_wait(&pool.cond, &pool.lock);
+        pthread_mutex_unlock(&pool.lock);
+
+        if (bit >= chunk->stop_bit) {
+            // a block of an earlier chunk covered this one
+        } else if (chunk->done && chunk->success && chunk->start_bit <= bit &&
+                   bit <= chunk->start_last &&
+                   chunk->min_marker >= MAX_DISTANCE - output->window_len) {
+            success = write_chunk(output, chunk);
+            bit = chunk->end_bit;
+            final = chunk->final;
+        } else {
+            // not a block start or failed to decode, the errors of
+            // actually broken blocks get reported from here
+            success = decode_chunk_again(&pool, output, chunk, &bit, &final);
+        }
+
+        free_chunk(chunk);
+
+        pthread_mutex_lock(&pool.lock);
+        pool.written_chunk = i + 1;
+        pthread_cond_broadcast(&pool.cond);
+        pthread_mutex_unlock(&pool.lock);
+    }
+
+    pthread_mutex_lock(&pool.lock);
+    pool.stop = true;
+    pthread_cond_broadcast(&pool.cond);
+    pthread_mutex_unlock(&pool.lock);
+
+    for (unsigned i = 0; i < started; ++i)
+        pthread_join(threads[i], NULL);
+
+    for (size_t i = 0; i < pool.chunk_cnt; ++i)
+        free_chunk(&pool.chunks[i]);
+
+    if (success && !final) {
+        log_error("Missing final block\n");
+        success = false;
+    }
+
+    if (success) {
+        // CRC32 starts at (next) byte boundary
+        *buf_pos = (size_t) ((bit + 7) / 8);
+        *crc = output->crc;
+        *size = output->size;
+    }
+
+    free(output);
+    free(threads);
+    free(pool.chunks);
+    pthread_cond_destroy(&pool.cond);
+    pthread_mutex_destroy(&pool.lock);
+    return success;
+}
@@ -0,0 +1,25 @@
+#ifndef SPECULATIVE
+#define SPECULATIVE
+
+#include "decompress.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+// compressed bytes of input decoded by one worker
+#define SPECULATIVE_CHUNK_SIZE 4194304
+
+// decompresses the blocks of the member at *buf_pos on options->threads
+// threads and sets *buf_pos to the position of its trailer, crc and size
+// are of the decompressed data
+bool decompress_blocks_parallel(uint8_t *buf, size_t buf_len, size_t *buf_pos,
+                                struct sink *sink,
+                                struct decompress_options *options,
+                                uint32_t *crc, uint64_t *size);
+
+// sets used[i] for each byte i of the 32768 bytes of output before the
+// block at bit_pos which the back references of the following blocks use
+bool find_window_references(uint8_t *buf, size_t buf_len, uint64_t bit_pos,
+                            bool *used);
+
+#endif
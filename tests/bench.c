@@ -0,0 +1,52 @@
+#include "../crc32.h"
+
+#include <stdio.h>
+#include <inttypes.h>
+#include <malloc.h>
+#include <time.h>
+
+#define CHUNK_SIZE 262144 // size of an output chunk written by the decoder
+#define BIG_SIZE (256 * 1024 * 1024)
+
+static double seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// CRC32 over len bytes of buf repeated until total bytes were processed
+static void bench_crc32(const char *name, uint8_t *buf, size_t len,
+                        uint64_t total)
+{
+    uint32_t crc = 0;
+    double start = seconds();
+    for (uint64_t done = 0; done < total; done += len)
+        crc = crc32_update(crc, buf, len);
+    double elapsed = seconds() - start;
+
+    double gb = total / 1e9;
+    printf("crc32 %-28s %6.2f GB/s  %7.2f ms per GB  (crc %08" PRIx32 ")\n",
+           name, gb / elapsed, elapsed * 1000 / gb, crc);
+    return;
+}
+
+int main()
+{
+    uint8_t *buf = malloc(BIG_SIZE);
+    if (buf == NULL) {
+        fprintf(stderr, "Failed to allocate benchmark buffer\n");
+        return 1;
+    }
+
+    for (size_t i = 0; i < BIG_SIZE; ++i)
+        buf[i] = (uint8_t) (i * 2654435761u >> 13);
+
+    // chunks still in cache as when the output buffer is flushed
+    bench_crc32("256KiB chunks (cached)", buf, CHUNK_SIZE, 4000000000ull);
+    // a separate pass over output which isn't in cache anymore
+    bench_crc32("256MiB buffer (uncached)", buf, BIG_SIZE, 4000000000ull);
+
+    free(buf);
+    return 0;
+}
@@ -1,8 +1,166 @@
 #include "../huffman_code.h"
+#include "../huffman_table.h"
+#include "../crc32.h"
+#include "../match_copy.h"
+#include "../log.h"
+#include "../deflate.h"
+#include "../ungzip_stream.h"
+#include "../index.h"
+#include "../index_file.h"
+#include "../decompress.h"
+#include "../speculative.h"
 
 #include <stdio.h>
 #include <string.h>
 #include <inttypes.h>
+#include <malloc.h>
+
+// writes the bits of a deflate stream, least significant bit first
+struct bit_writer {
+    uint8_t *buf;
+    size_t pos;
+    uint64_t bits;
+    uint8_t bit_cnt;
+};
+
+static void put_bits(struct bit_writer *w, uint32_t value, uint8_t n)
+{
+    w->bits |= (uint64_t) value << w->bit_cnt;
+    w->bit_cnt += n;
+    while (w->bit_cnt >= 8) {
+        w->buf[w->pos++] = (uint8_t) w->bits;
+        w->bits >>= 8;
+        w->bit_cnt -= 8;
+    }
+    return;
+}
+
+// canonical codes for lengths, bit reversed so put_bits writes them
+// ref: https://www.ietf.org/rfc/rfc1951.txt section 3.2.2
+static void canonical_codes(const uint8_t *lengths, uint16_t cnt,
+                            uint16_t *codes)
+{
+    uint16_t len_cnt[16] = {0};
+    for (uint16_t i = 0; i < cnt; ++i)
+        len_cnt[lengths[i]]++;
+    len_cnt[0] = 0;
+
+    uint16_t next[16] = {0};
+    for (uint8_t len = 1; len < 16; ++len)
+        next[len] = (uint16_t) ((next[len - 1] + len_cnt[len - 1]) << 1);
+
+    for (uint16_t i = 0; i < cnt; ++i) {
+        uint16_t code = next[lengths[i]]++;
+        uint16_t reversed = 0;
+        for (uint8_t j = 0; j < lengths[i]; ++j)
+            reversed |= (uint16_t) (((code >> j) & 1) << (lengths[i] - 1 - j));
+        codes[i] = reversed;
+    }
+    return;
+}
+
+static uint64_t next_random(uint64_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+// a gzip member of dynamic blocks for data_len bytes of random literals
+// and matches of up to 32768 bytes back, which are written to data. The
+// blocks use complete codes close to the fixed ones, so the searches for
+// block starts of the speculative decoder find them
+static size_t make_test_member(uint8_t *data, size_t data_len,
+                               uint8_t *member)
+{
+    uint8_t ll_lengths[286];
+    uint8_t d_lengths[30];
+    uint8_t cl_lengths[19] = {0};
+    uint16_t ll_codes[286];
+    uint16_t d_codes[30];
+    uint16_t cl_codes[19];
+    for (uint16_t i = 0; i < 286; ++i)
+        ll_lengths[i] = i < 144 ? 8 : i < 256 ? 9 : i < 280 ? 7 :
+            i < 284 ? 8 : 7;
+    for (uint8_t i = 0; i < 30; ++i)
+        d_lengths[i] = i < 2 ? 4 : 5;
+    cl_lengths[4] = 3;
+    cl_lengths[5] = 2;
+    cl_lengths[7] = 2;
+    cl_lengths[8] = 2;
+    cl_lengths[9] = 3;
+    canonical_codes(ll_lengths, 286, ll_codes);
+    canonical_codes(d_lengths, 30, d_codes);
+    canonical_codes(cl_lengths, 19, cl_codes);
+
+    static const uint8_t cl_order[12] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5,
+                                         11, 4};
+    static const uint8_t header[10] = {0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00,
+                                       0x00, 0x00, 0x00, 0x03};
+    memcpy(member, header, sizeof(header));
+    struct bit_writer w = {member, sizeof(header), 0, 0};
+
+    uint64_t state = 0x9e3779b97f4a7c15;
+    size_t pos = 0;
+    while (pos < data_len) {
+        size_t block_end = data_len - pos > 65536 ? pos + 65536 : data_len;
+        put_bits(&w, block_end == data_len, 1);
+        put_bits(&w, 2, 2);
+        put_bits(&w, 286 - 257, 5);
+        put_bits(&w, 30 - 1, 5);
+        put_bits(&w, sizeof(cl_order) - 4, 4);
+        for (uint8_t i = 0; i < sizeof(cl_order); ++i)
+            put_bits(&w, cl_lengths[cl_order[i]], 3);
+        for (uint16_t i = 0; i < 286; ++i)
+            put_bits(&w, cl_codes[ll_lengths[i]], cl_lengths[ll_lengths[i]]);
+        for (uint8_t i = 0; i < 30; ++i)
+            put_bits(&w, cl_codes[d_lengths[i]], cl_lengths[d_lengths[i]]);
+
+        while (pos < block_end) {
+            size_t run = next_random(&state) % 32;
+            for (; run > 0 && pos < block_end; --run) {
+                data[pos] = (uint8_t) next_random(&state);
+                put_bits(&w, ll_codes[data[pos]], ll_lengths[data[pos]]);
+                pos++;
+            }
+            if (pos == 0 || block_end - pos < 3)
+                continue;
+
+            size_t len = 3 + next_random(&state) % 38;
+            if (len > block_end - pos)
+                len = block_end - pos;
+            size_t dist = 1 + next_random(&state) %
+                (pos < MAX_DISTANCE ? pos : MAX_DISTANCE);
+            for (size_t i = 0; i < len; ++i)
+                data[pos + i] = data[pos + i - dist];
+            pos += len;
+
+            uint8_t l = 28;
+            while (length_data[l].value > len)
+                l--;
+            put_bits(&w, ll_codes[257 + l], ll_lengths[257 + l]);
+            put_bits(&w, (uint32_t) (len - length_data[l].value),
+                     length_data[l].extra_bits);
+            uint8_t d = 29;
+            while (dist_data[d].value > dist)
+                d--;
+            put_bits(&w, d_codes[d], d_lengths[d]);
+            put_bits(&w, (uint32_t) (dist - dist_data[d].value),
+                     dist_data[d].extra_bits);
+        }
+        put_bits(&w, ll_codes[256], ll_lengths[256]);
+    }
+    if (w.bit_cnt)
+        put_bits(&w, 0, 8 - w.bit_cnt);
+
+    uint32_t crc = crc32_update(0, data, data_len);
+    for (uint8_t i = 0; i < 4; ++i)
+        put_bits(&w, (uint8_t) (crc >> (8 * i)), 8);
+    for (uint8_t i = 0; i < 4; ++i)
+        put_bits(&w, (uint8_t) (data_len >> (8 * i)), 8);
+    return w.pos;
+}
 
 int main()
 {
@@ -68,6 +226,323 @@ int main()
         return 1;
     }
 
+    // the table is indexed by the codes above with their bits reversed
+    struct huffman_entry entries[1024];
+    struct huffman_table table;
+    success = create_huffman_table(lengths, 288, 15, 9, entries, 1024,
+                                   &table);
+    if (!success || table.size != 512 || table.entries[0x00c].symbol != 0 ||
+        table.entries[0x10c].symbol != 0 || table.entries[0x00c].len != 8 ||
+        table.entries[0x1ff].symbol != 255 || table.entries[0].symbol != 256 ||
+        table.entries[0].len != 7 || table.entries[0x0e3].symbol != 287) {
+        fprintf(stderr, "table of the fixed codes didn't match\n");
+        return 1;
+    }
+
+    // a 7 bit code in a 2 bit primary table continues in a 32 entry
+    // sub-table, the missing codes of an incomplete code have len 0
+    uint8_t incomplete[3] = {1, 2, 7};
+    success = create_huffman_table(incomplete, 3, 15, 2, entries, 1024,
+                                   &table);
+    if (!success || table.size != 4 + 32 || table.entries[1].len != 2 ||
+        table.entries[3].sub_bits != 5 || table.entries[4].len != 7 ||
+        table.entries[4].symbol != 2 || table.entries[5].len != 0) {
+        fprintf(stderr, "table of an incomplete code didn't match\n");
+        return 1;
+    }
+
+    quiet_errors = true;
+    uint8_t over_subscribed[3] = {1, 1, 2};
+    success = create_huffman_table(over_subscribed, 3, 15, 2, entries, 1024,
+                                   &table) ||
+        create_huffman_table(incomplete, 3, 15, 2, entries, 35, &table);
+    quiet_errors = false;
+    if (success) {
+        fprintf(stderr, "Expected create_huffman_table to fail\n");
+        return 1;
+    }
+
+    // with codes 0, 110, 10 and 111 the extra bit of symbol 2 fits in
+    // a 4 bit index but 11 is above max, the 2 of symbol 3 don't fit
+    uint8_t value_lengths[4] = {1, 3, 2, 3};
+    struct value_and_bits value_data[2] = {{10, 1}, {20, 2}};
+    struct huffman_values values = {2, 2, value_data, 10};
+    success = create_huffman_value_table(value_lengths, 4, 15, 4, &values,
+                                         entries, 1024, &table);
+    if (!success || entries[1].symbol != 10 || entries[1].len != 3 ||
+        entries[1].sub_bits != VALUE_EXTRA || entries[5].symbol != 10 ||
+        entries[5].len != 2 || entries[5].sub_bits != VALUE_EXTRA + 1 ||
+        entries[7].symbol != 20 || entries[7].sub_bits != VALUE_EXTRA + 2 ||
+        entries[3].symbol != 1 || entries[3].sub_bits != 0) {
+        fprintf(stderr, "table with values didn't match\n");
+        return 1;
+    }
+
+    // with codes 0, 10, 110 and 111 for 'a', 'b', end of block and a
+    // length, bits starting with "0 0", "0 10" or "10 0" hold pairs
+    uint8_t pair_lengths[258] = {0};
+    pair_lengths['a'] = 1;
+    pair_lengths['b'] = 2;
+    pair_lengths[256] = 3;
+    pair_lengths[257] = 3;
+    success = create_huffman_table(pair_lengths, 258, 15, 3, entries, 1024,
+                                   &table);
+    add_literal_pairs(entries, 3);
+    if (!success || entries[0].sub_bits != LITERAL_PAIR ||
+        entries[0].symbol != ('a' | 'a' << 8) || entries[0].len != 2 ||
+        entries[2].symbol != ('a' | 'b' << 8) || entries[2].len != 3 ||
+        entries[1].symbol != ('b' | 'a' << 8) || entries[1].len != 3 ||
+        entries[5].sub_bits != 0 || entries[5].symbol != 'b' ||
+        entries[6].sub_bits != 0 || entries[6].symbol != 'a') {
+        fprintf(stderr, "literal pairs didn't match\n");
+        return 1;
+    }
+
+    // with 4 bit codes for 15 hex digits, end of block and two lengths,
+    // any two digits fit in 10 bits, which pays for the wider table once
+    // the block is large enough
+    uint8_t hex_lengths[259] = {0};
+    for (uint8_t i = 0; i < 15; ++i)
+        hex_lengths["0123456789abcde"[i]] = 4;
+    hex_lengths[256] = 5;
+    hex_lengths[257] = 6;
+    hex_lengths[258] = 6;
+    if (choose_ll_primary_bits(hex_lengths, 259, 100) != LL_PRIMARY_BITS ||
+        choose_ll_primary_bits(hex_lengths, 259, 1048576) !=
+        LL_PRIMARY_BITS + 1) {
+        fprintf(stderr, "primary bits of the hex digit table didn't match\n");
+        return 1;
+    }
+
+    // check value of the crc
+    // ref: https://reveng.sourceforge.io/crc-catalogue/17plus.htm#crc.cat.crc-32-iso-hdlc
+    uint8_t check[] = "123456789";
+    if (crc32_update(0, check, 9) != 0xcbf43926) {
+        fprintf(stderr, "crc32 of check string didn't match\n");
+        return 1;
+    }
+
+    // long enough for the folding kernel, with a tail, split in two updates
+    uint8_t data[1000];
+    for (uint16_t i = 0; i < 1000; ++i)
+        data[i] = (uint8_t) (i * 7 + 3);
+
+    uint32_t whole = crc32_update(0, data, 1000);
+    uint32_t split = crc32_update(crc32_update(0, data, 333), data + 333, 667);
+    if (whole != split) {
+        fprintf(stderr, "crc32 of split data didn't match\n");
+        return 1;
+    }
+
+    uint32_t bytewise = 0;
+    for (uint16_t i = 0; i < 1000; ++i)
+        bytewise = crc32_update(bytewise, data + i, 1);
+    if (whole != bytewise) {
+        fprintf(stderr, "crc32 of data updated a byte at a time didn't match\n");
+        return 1;
+    }
+
+    // every kernel, the scalar one too, copies what a copy byte by byte
+    // does at any alignment and writes nothing past the slack after the
+    // match or before it
+    uint8_t copy_ref[64 + 32 + 258 + MATCH_COPY_SLACK + 16];
+    uint8_t copy_out[sizeof(copy_ref)];
+    for (unsigned k = 0; k < match_copy_kernel_cnt; ++k) {
+        const struct match_copy_kernel *kernel = &match_copy_kernels[k];
+        for (uint16_t distance = 1; distance <= 40; ++distance) {
+            for (uint16_t length = 3; length <= 258; ++length) {
+                for (uint8_t align = 0; align < 32; align += 5) {
+                    for (size_t i = 0; i < sizeof(copy_ref); ++i)
+                        copy_ref[i] = (uint8_t) (i < 64 ? i * 37 + 1 : 0xaa);
+                    memcpy(copy_out, copy_ref, sizeof(copy_ref));
+
+                    uint8_t *ref = copy_ref + 64 + align;
+                    for (uint16_t i = 0; i < length; ++i)
+                        ref[i] = ref[i - distance];
+                    kernel->copy(copy_out + 64 + align, distance, length);
+
+                    size_t end = 64 + align + length + MATCH_COPY_SLACK;
+                    bool past = false;
+                    for (size_t i = end; i < sizeof(copy_out); ++i)
+                        past |= copy_out[i] != 0xaa;
+                    if (memcmp(copy_out, copy_ref, 64 + align + length) ||
+                        past) {
+                        fprintf(stderr, "%s match copy of length %u at "
+                                "distance %u didn't match\n", kernel->name,
+                                length, distance);
+                        return 1;
+                    }
+                }
+            }
+        }
+    }
+
+    // a member with a dynamic block fed and read a few bytes at a time
+    // stops in the header, the code lengths and matches
+    static const uint8_t member[] = {
+        0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0xed, 0xd4,
+        0xbb, 0x0d, 0x02, 0x31, 0x10, 0x06, 0xe1, 0x56, 0x5c, 0x00, 0x01, 0xbb,
+        0xe6, 0x59, 0x0e, 0x81, 0xd1, 0x21, 0x1d, 0x20, 0x71, 0xee, 0x5f, 0x88,
+        0x02, 0x76, 0x12, 0xd2, 0x89, 0xff, 0xc8, 0xa3, 0xf5, 0xb7, 0x3e, 0x5e,
+        0xa3, 0xed, 0xdb, 0xfb, 0xde, 0xe6, 0x32, 0xda, 0x36, 0x3f, 0xe3, 0xf6,
+        0x6c, 0x73, 0x6c, 0x73, 0xd7, 0xd6, 0xdf, 0x14, 0xf5, 0x94, 0xf5, 0xd4,
+        0xeb, 0xe9, 0x50, 0x4f, 0xc7, 0x7a, 0x3a, 0xd5, 0xd3, 0xb9, 0x9e, 0x2e,
+        0xf5, 0x74, 0x85, 0x27, 0x53, 0x0e, 0xe8, 0x11, 0x10, 0x24, 0xa0, 0x48,
+        0x40, 0x92, 0x80, 0x26, 0x01, 0x51, 0x02, 0xaa, 0x04, 0x64, 0x09, 0xe8,
+        0x92, 0xd0, 0x25, 0xe9, 0x4e, 0xa0, 0x4b, 0x42, 0x97, 0x84, 0x2e, 0x09,
+        0x5d, 0x12, 0xba, 0x24, 0x74, 0x49, 0xe8, 0x92, 0xd0, 0xa5, 0x43, 0x97,
+        0x0e, 0x5d, 0x3a, 0x7d, 0x20, 0xe8, 0xd2, 0xa1, 0x4b, 0x87, 0x2e, 0x1d,
+        0xba, 0x28, 0x80, 0x02, 0x28, 0x80, 0x02, 0x28, 0x80, 0x02, 0x28, 0x80,
+        0x02, 0x28, 0x80, 0x02, 0x28, 0x80, 0x02, 0x28, 0x80, 0x02, 0x28, 0x80,
+        0x02, 0x28, 0x80, 0x02, 0x28, 0x80, 0x02, 0x28, 0x80, 0x02, 0x28, 0x80,
+        0x02, 0x28, 0x80, 0x02, 0x28, 0x80, 0x02, 0xfc, 0x25, 0xc0, 0x17, 0x31,
+        0xe7, 0xb0, 0xd9, 0x7c, 0x20, 0x00, 0x00
+    };
+    char expected[9000];
+    size_t expected_len = 0;
+    for (uint16_t i = 0; i < 300; ++i)
+        expected_len += sprintf(expected + expected_len,
+                                "line %d of the stream test, ", i % 37);
+
+    struct ungzip_stream s;
+    if (!ungzip_stream_init(&s)) {
+        fprintf(stderr, "Expected ungzip_stream_init to succeed\n");
+        return 1;
+    }
+
+    uint8_t out[9000];
+    size_t out_len = 0;
+    enum ungzip_stream_status status = UNGZIP_STREAM_NEED_INPUT;
+    for (size_t i = 0; i < sizeof(member); ++i) {
+        ungzip_stream_feed(&s, member + i, 1);
+        do {
+            size_t written = 0;
+            status = ungzip_stream_read(&s, out + out_len, 3, &written);
+            out_len += written;
+        } while (status == UNGZIP_STREAM_OK && out_len < sizeof(out) - 3);
+        if (status == UNGZIP_STREAM_ERROR)
+            break;
+    }
+    ungzip_stream_end(&s);
+
+    if (status != UNGZIP_STREAM_END || out_len != expected_len ||
+        memcmp(out, expected, expected_len) != 0) {
+        fprintf(stderr, "stream decompressed a byte at a time didn't match\n");
+        return 1;
+    }
+
+    struct sink sink;
+    init_memory_sink(&sink);
+    if (!ungzip_stream_init(&s)) {
+        fprintf(stderr, "Expected ungzip_stream_init to succeed\n");
+        return 1;
+    }
+    for (size_t i = 0; i < sizeof(member); i += 7) {
+        size_t len = sizeof(member) - i < 7 ? sizeof(member) - i : 7;
+        ungzip_stream_feed(&s, member + i, len);
+        status = ungzip_stream_write(&s, &sink);
+        if (status == UNGZIP_STREAM_ERROR)
+            break;
+    }
+    ungzip_stream_end(&s);
+
+    success = status == UNGZIP_STREAM_END && sink.len == expected_len &&
+        memcmp(sink.buf, expected, expected_len) == 0;
+    free(sink.buf);
+    if (!success) {
+        fprintf(stderr, "stream written to a memory sink didn't match\n");
+        return 1;
+    }
+
+    // an index of two members has only checkpoints at the member starts,
+    // with empty windows, and reads back from its file the same
+    uint8_t members[2 * sizeof(member)];
+    memcpy(members, member, sizeof(member));
+    memcpy(members + sizeof(member), member, sizeof(member));
+    FILE *f = fopen("test_index.gz", "wb");
+    success = f != NULL &&
+        fwrite(members, 1, sizeof(members), f) == sizeof(members);
+    if (f != NULL && fclose(f) != 0)
+        success = false;
+
+    struct gzip_index index;
+    init_index(&index, DEFAULT_INDEX_SPAN);
+    success = success && build_index(members, sizeof(members), &index) &&
+        index.cnt == 2 && index.points[1].window_len == 0 &&
+        write_index_file(&index, "test_index.gz.idx", "test_index.gz",
+                         members, sizeof(members));
+    free_index(&index);
+
+    init_memory_sink(&sink);
+    success = success &&
+        open_index_file("test_index.gz.idx", "test_index.gz", members,
+                        sizeof(members), &index) && index.cnt == 2 &&
+        extract_range(members, sizeof(members), &index, expected_len - 10,
+                      20, &sink) && sink.len == 20 &&
+        memcmp(sink.buf, expected + expected_len - 10, 10) == 0 &&
+        memcmp(sink.buf + 10, expected, 10) == 0;
+    free_index(&index);
+    free(sink.buf);
+    if (!success) {
+        fprintf(stderr, "index read back from its file didn't match\n");
+        return 1;
+    }
+
+    // a byte flipped in the records is caught by the CRC32 of the index
+    f = fopen("test_index.gz.idx", "r+b");
+    int byte = EOF;
+    success = f != NULL && fseek(f, INDEX_HEADER_SIZE, SEEK_SET) == 0 &&
+        (byte = fgetc(f)) != EOF &&
+        fseek(f, INDEX_HEADER_SIZE, SEEK_SET) == 0 && fputc(byte ^ 1, f) != EOF;
+    if (f != NULL && fclose(f) != 0)
+        success = false;
+    quiet_errors = true;
+    if (!success || open_index_file("test_index.gz.idx", "test_index.gz",
+                                    members, sizeof(members), &index)) {
+        quiet_errors = false;
+        fprintf(stderr, "Expected open_index_file of a damaged index to fail\n");
+        return 1;
+    }
+    quiet_errors = false;
+
+    remove("test_index.gz");
+    remove("test_index.gz.idx");
+
+    // a member of a few speculative chunks, whose back references reach
+    // across the chunk boundaries, decompresses the same on two threads
+    size_t big_data_len = 5 * (size_t) SPECULATIVE_CHUNK_SIZE;
+    uint8_t *big_data = malloc(big_data_len);
+    uint8_t *big_member = malloc(2 * big_data_len);
+    if (big_data == NULL || big_member == NULL) {
+        fprintf(stderr, "Failed to allocate the speculative test member\n");
+        return 1;
+    }
+    size_t big_member_len = make_test_member(big_data, big_data_len,
+                                             big_member);
+
+    struct sink one_thread_sink;
+    init_memory_sink(&one_thread_sink);
+    init_memory_sink(&sink);
+    struct decompress_options options = {false, 1, NULL, DEFAULT_WRITE_SIZE,
+                                         NULL};
+    success = big_member_len > 2 * SPECULATIVE_CHUNK_SIZE &&
+        decompress_members(big_member, big_member_len, &one_thread_sink,
+                           &options);
+    options.threads = 2;
+    success = success &&
+        decompress_members(big_member, big_member_len, &sink, &options) &&
+        one_thread_sink.len == big_data_len && sink.len == big_data_len &&
+        memcmp(one_thread_sink.buf, big_data, big_data_len) == 0 &&
+        memcmp(sink.buf, big_data, big_data_len) == 0;
+    free(one_thread_sink.buf);
+    free(sink.buf);
+    free(big_member);
+    free(big_data);
+    if (!success) {
+        fprintf(stderr, "member decompressed on two threads didn't match\n");
+        return 1;
+    }
+
     printf("All tests passed\n");
     return 0;
 }
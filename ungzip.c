@@ -1,59 +1,106 @@
 #include "decompress.h"
+#include "index.h"
+#include "index_file.h"
+#include "input.h"
+#include "uring.h"
 
 #include <stdio.h>
 #include <string.h>
 #include <inttypes.h>
 #include <stdbool.h>
 #include <malloc.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
 
-uint8_t *read_gzipped_file(char *filename, size_t *buf_len)
-{
-    FILE *f = fopen(filename, "rb");
-    if (f == NULL)
-        return NULL;
+#define MAX_THREADS 1024
 
-    int seek = fseek(f, 0, SEEK_END);
-    if (seek != 0)
-        goto fail;
-
-    long tmp = (size_t) ftell(f);
-    if (tmp == -1)
-        goto fail;
+void usage()
+{
+    printf("Usage: ungzip [-C] [-m] [-t] [-u] [-j threads] [-b size] "
+           "filename.gz\n");
+    printf("       ungzip [-C] [-t] [-u] [-b size] - < filename.gz > "
+           "filename\n");
+    printf("       ungzip -x offset,length [-s span] filename.gz\n");
+    printf("       ungzip -h\n");
+    printf("\n");
+    printf("  -C  compute CRC32 on a separate thread for large members\n");
+    printf("  -j  decompress members on this many threads\n");
+    printf("  -b  bytes of output written at a time (default %d)\n",
+           DEFAULT_WRITE_SIZE);
+    printf("  -m  preallocate the output file from the size in the trailer "
+           "and\n      decompress into a mapping of it\n");
+    printf("  -t  print the time spent creating the tables of dynamic "
+           "blocks and\n      decoding them by table width to stderr\n");
+    printf("  -u  read streams and write output with io_uring if the "
+           "kernel\n      supports it\n");
+    printf("  -x  write length bytes of output starting at offset to stdout\n");
+    printf("  -s  bytes of output between index checkpoints (default %d)\n",
+           DEFAULT_INDEX_SPAN);
+    return;
+}
 
-    size_t len = (size_t) tmp;
+// returns false if not a valid size
+bool parse_size(char *cmd_arg, uint64_t *size)
+{
+    if (*cmd_arg < '0' || *cmd_arg > '9')
+        return false;
 
-    seek = fseek(f, 0, SEEK_SET);
-    if (seek != 0)
-        goto fail;
+    char *end = NULL;
+    unsigned long long tmp = strtoull(cmd_arg, &end, 10);
+    if (end == cmd_arg || *end != '\0')
+        return false;
 
-    uint8_t *buf = (uint8_t *) malloc(len);
-    if (buf == NULL)
-        goto fail;
+    *size = tmp;
+    return true;
+}
 
-    if (fread(buf, 1, len, f) != len) {
-        free(buf);
-        goto fail;
-    }
+// returns false if not a valid offset,length pair
+bool parse_range(char *cmd_arg, uint64_t *offset, uint64_t *len)
+{
+    char *comma = strchr(cmd_arg, ',');
+    if (comma == NULL)
+        return false;
 
-    fclose(f);
-    *buf_len = len;
+    *comma = '\0';
+    bool success = parse_size(cmd_arg, offset) && parse_size(comma + 1, len);
+    *comma = ',';
+    return success;
+}
 
-    return buf;
+// returns 0 if not a valid number of threads
+unsigned parse_threads(char *cmd_arg)
+{
+    char *end = NULL;
+    long threads = strtol(cmd_arg, &end, 10);
+    if (end == cmd_arg || *end != '\0' || threads < 1 || threads > MAX_THREADS)
+        return 0;
 
- fail:
-    fclose(f);
-    return NULL;
+    return (unsigned) threads;
 }
 
-void usage()
+void print_table_stats(const struct table_stats *stats)
 {
-    printf("Usage: ungzip filename.gz\n");
-    printf("       ungzip -h\n");
+    fprintf(stderr, "bits    blocks        output  create ns/block  "
+            "decode ns/KiB\n");
+    for (unsigned bits = 0; bits <= MAX_LL_PRIMARY_BITS; ++bits) {
+        if (stats->blocks[bits] == 0)
+            continue;
+        fprintf(stderr, "%4u  %8" PRIu64 "  %12" PRIu64 "  %15" PRIu64
+                "  %13" PRIu64 "\n", bits, stats->blocks[bits],
+                stats->output[bits],
+                stats->create_ns[bits] / stats->blocks[bits],
+                stats->output[bits] ? stats->decode_ns[bits] * 1024 /
+                stats->output[bits] : 0);
+    }
     return;
 }
 
 char *gzip_filename(char *cmd_arg)
 {
+    if (strcmp(cmd_arg, "-") == 0)
+        return cmd_arg;
+
     int len = strlen(cmd_arg);
 
     if (len < 4 || cmd_arg[len - 3] != '.' || cmd_arg[len - 2] != 'g' ||
@@ -65,50 +112,230 @@ char *gzip_filename(char *cmd_arg)
     return cmd_arg;
 }
 
-int main(int argc, char *argv[])
+// the index is read from filename.idx, or built by decompressing all of
+// the file and saved there if it doesn't exist or is out of date
+bool extract_file(char *filename, uint8_t *buf, size_t buf_len, uint64_t span,
+                  uint64_t offset, uint64_t length)
 {
-    if (argc != 2) {
-        usage();
+    char *index_filename = malloc(strlen(filename) + 5);
+    if (index_filename == NULL)
+        return false;
+    strcpy(index_filename, filename);
+    strcat(index_filename, ".idx");
+
+    struct gzip_index index;
+    bool success = open_index_file(index_filename, filename, buf, buf_len,
+                                   &index);
+    if (!success) {
+        init_index(&index, span);
+        success = build_index(buf, buf_len, &index);
+        if (success && !write_index_file(&index, index_filename, filename,
+                                         buf, buf_len))
+            fprintf(stderr, "Continuing without saving the index\n");
+    }
+
+    if (success) {
+        struct sink sink;
+        init_fd_sink(&sink, STDOUT_FILENO);
+        success = extract_range(buf, buf_len, &index, offset, length, &sink);
+    }
+
+    free_index(&index);
+    free(index_filename);
+    return success;
+}
+
+// stdin is decompressed to stdout, other streams like FIFOs to a file
+// named without the .gz extension
+int decompress_input_stream(char *filename,
+                            struct decompress_options *options, bool uring)
+{
+    struct input_stream s;
+    if (!open_input_stream(filename, &s, uring)) {
+        fprintf(stderr, "Failed to open %s\n", filename);
+        return 1;
+    }
+
+    bool to_stdout = strcmp(filename, "-") == 0;
+    if (!to_stdout)
+        filename[strlen(filename) - 3] = '\0';
+    int fd = to_stdout ? STDOUT_FILENO :
+        open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd == -1) {
+        close_input_stream(&s);
+        fprintf(stderr, "Failed to open %s to write to\n", filename);
+        return 1;
+    }
+
+    struct sink sink;
+    if (!uring || !init_uring_sink(&sink, fd, options->write_size))
+        init_fd_sink(&sink, fd);
+    bool success = decompress_stream(&s, &sink, options);
+    close_input_stream(&s);
+    if (!finish_sink(&sink))
+        success = false;
+    if (!to_stdout && close(fd) != 0)
+        success = false;
+    if (!success) {
+        if (!to_stdout)
+            remove(filename);
+        fprintf(stderr, "Failed to decompress file. exiting...\n");
         return 1;
     }
 
-    if (strlen(argv[1]) == 2 && argv[1][0] == '-' && argv[1][1] == 'h') {
+    if (!to_stdout)
+        printf("Successfully decompressed into %s\n", filename);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    struct decompress_options options;
+    options.crc_thread = false;
+    options.threads = 1;
+    options.index = NULL;
+    options.write_size = DEFAULT_WRITE_SIZE;
+    options.stats = NULL;
+
+    struct table_stats stats;
+    memset(&stats, 0, sizeof(stats));
+    bool extract = false;
+    bool map_output = false;
+    bool uring = false;
+    uint64_t offset = 0;
+    uint64_t length = 0;
+    uint64_t span = DEFAULT_INDEX_SPAN;
+    uint64_t write_size = DEFAULT_WRITE_SIZE;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "hCmtuj:b:x:s:")) != -1) {
+        switch (opt) {
+        case 'h':
+            usage();
+            return 0;
+        case 'C':
+            options.crc_thread = true;
+            break;
+        case 'm':
+            map_output = true;
+            break;
+        case 't':
+            options.stats = &stats;
+            break;
+        case 'u':
+            uring = true;
+            break;
+        case 'j':
+            options.threads = parse_threads(optarg);
+            if (options.threads == 0) {
+                fprintf(stderr, "Expecting number of threads between 1 "
+                        "and %d\n", MAX_THREADS);
+                return 1;
+            }
+            break;
+        case 'b':
+            if (!parse_size(optarg, &write_size) ||
+                write_size < MIN_WRITE_SIZE || write_size > MAX_WRITE_SIZE) {
+                fprintf(stderr, "Expecting write size between %d and %d "
+                        "bytes\n", MIN_WRITE_SIZE, MAX_WRITE_SIZE);
+                return 1;
+            }
+            options.write_size = (size_t) write_size;
+            break;
+        case 'x':
+            extract = parse_range(optarg, &offset, &length);
+            if (!extract) {
+                fprintf(stderr, "Expecting offset,length in bytes\n");
+                return 1;
+            }
+            break;
+        case 's':
+            if (!parse_size(optarg, &span) || span == 0) {
+                fprintf(stderr, "Expecting span of at least 1 byte\n");
+                return 1;
+            }
+            break;
+        default:
+            usage();
+            return 1;
+        }
+    }
+
+    if (optind != argc - 1) {
         usage();
-        return 0;
+        return 1;
     }
 
-    char *filename = gzip_filename(argv[1]);
+    char *filename = gzip_filename(argv[optind]);
 
     if (filename == NULL)
         return 1;
 
-    size_t buf_len = 0;
-    uint8_t *buf = read_gzipped_file(filename, &buf_len);
-    if (buf == NULL) {
-        fprintf(stderr, "Failed to read %s file into memory\n", filename);
+    if (is_input_stream(filename)) {
+        if (extract) {
+            fprintf(stderr, "Expecting a regular file to extract from\n");
+            return 1;
+        }
+        int status = decompress_input_stream(filename, &options, uring);
+        if (options.stats != NULL)
+            print_table_stats(options.stats);
+        return status;
+    }
+
+    struct input in;
+    if (!open_input(filename, &in)) {
+        fprintf(stderr, "Failed to read %s\n", filename);
         return 1;
     }
+    uint8_t *buf = in.buf;
+    size_t buf_len = in.len;
+
+    if (extract) {
+        bool success = extract_file(filename, buf, buf_len, span, offset,
+                                    length);
+        close_input(&in);
+        if (!success) {
+            fprintf(stderr, "Failed to extract from file. exiting...\n");
+            return 1;
+        }
+        return 0;
+    }
 
     int32_t len = strlen(filename);
     filename[len - 3] = '\0';
-    FILE *f = fopen(filename, "wb");
-    if (f == NULL) {
-        free(buf);
+    // a shared mapping for writing needs the file open for reading too
+    int fd = open(filename, (map_output ? O_RDWR : O_WRONLY) | O_CREAT |
+                  O_TRUNC, 0666);
+    if (fd == -1) {
+        close_input(&in);
         fprintf(stderr, "Failed to open %s to write to\n", filename);
         return 1;
     }
 
-    bool success = decompress_members(buf, buf_len, f);
+    // without a size hint the output is written to fd, with io_uring if
+    // asked for and supported
+    struct sink sink;
+    uint64_t size = 0;
+    bool mapped = map_output && output_size_hint(buf, buf_len, &size) &&
+        size <= SIZE_MAX && init_map_sink(&sink, fd, (size_t) size);
+    if (!mapped && (!uring || !init_uring_sink(&sink, fd,
+                                               options.write_size)))
+        init_fd_sink(&sink, fd);
+
+    bool success = decompress_members(buf, buf_len, &sink, &options);
+    close_input(&in);
+    if (!finish_sink(&sink))
+        success = false;
+    if (close(fd) != 0)
+        success = false;
     if (!success) {
-        free(buf);
-        fclose(f);
         remove(filename);
         fprintf(stderr, "Failed to decompress file. exiting...\n");
         return 1;
     }
 
-    free(buf);
-    fclose(f);
+    if (options.stats != NULL)
+        print_table_stats(options.stats);
     printf("Successfully decompressed into %s\n", filename);
     return 0;
 }
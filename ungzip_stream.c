@@ -0,0 +1,701 @@
+#include "ungzip_stream.h"
+#include "deflate.h"
+#include "huffman_table.h"
+#include "bit_reader.h"
+#include "match_copy.h"
+#include "crc32.h"
+#include "log.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <malloc.h>
+
+// member header flags
+// ref: https://www.rfc-editor.org/rfc/rfc1952.txt section 2.3.1
+#define FHCRC 0x02u
+#define FEXTRA 0x04u
+#define FNAME 0x08u
+#define FCOMMENT 0x10u
+#define FRESERVED 0xe0u
+
+// the fast loop decodes whole symbols without checking for input while
+// there is a full word of input left for refilling
+#define FAST_INPUT_MARGIN 8
+
+bool ungzip_stream_init(struct ungzip_stream *s)
+{
+    return ungzip_stream_init_size(s, UNGZIP_STREAM_READ_SIZE);
+}
+
+// output buffer holds the window and up to read_size bytes of output
+// that wasn't read yet, with room for what match copies write past its
+// end
+bool ungzip_stream_init_size(struct ungzip_stream *s, size_t read_size)
+{
+    if (read_size < UNGZIP_STREAM_MIN_READ_SIZE ||
+        read_size > SIZE_MAX - MAX_DISTANCE - MATCH_COPY_SLACK) {
+        log_error("Invalid output buffer size\n");
+        return false;
+    }
+
+    s->out_size = MAX_DISTANCE + read_size;
+    s->out_buf = malloc(s->out_size + MATCH_COPY_SLACK);
+    if (s->out_buf == NULL) {
+        log_error("Failed to allocate output buffer\n");
+        return false;
+    }
+
+    s->state = STREAM_HEADER;
+    bit_reader_init(&s->in, NULL, 0, 0);
+    s->cnt = 0;
+    s->members = 0;
+    s->out_pos = 0;
+    s->read_pos = 0;
+    s->crc_pos = 0;
+    s->member_start = 0;
+    s->crc = 0;
+    s->size = 0;
+    return true;
+}
+
+void ungzip_stream_end(struct ungzip_stream *s)
+{
+    free(s->out_buf);
+    s->out_buf = NULL;
+    return;
+}
+
+bool ungzip_stream_feed(struct ungzip_stream *s, const uint8_t *buf,
+                        size_t len)
+{
+    if (s->in.buf_pos != s->in.buf_len)
+        return false;
+
+    // bits loaded from the previous input stay in the bit buffer
+    s->in.buf = buf;
+    s->in.buf_len = len;
+    s->in.buf_pos = 0;
+    return true;
+}
+
+// loads input bytes until the bit buffer holds n bits, returns false if
+// the input runs out first
+static bool need_bits(struct bit_reader *in, uint8_t n)
+{
+    while (in->bit_cnt < n) {
+        if (in->buf_pos == in->buf_len)
+            return false;
+        in->bits |= (uint64_t) in->buf[in->buf_pos++] << in->bit_cnt;
+        in->bit_cnt += 8;
+    }
+
+    return true;
+}
+
+static bool get_byte(struct bit_reader *in, uint8_t *byte)
+{
+    if (!need_bits(in, 8))
+        return false;
+
+    *byte = (uint8_t) take_bits(in, 8);
+    return true;
+}
+
+// a code is only taken once all of its bits are loaded, missing bits
+// look like zeros to the lookup so a code which seems to be invalid may
+// just need more input. Returns false if more input is needed and sets
+// *valid to false if no code matches
+static bool decode_stream_symbol(struct bit_reader *in,
+                                 const struct huffman_table *table,
+                                 uint16_t *symbol, bool *valid)
+{
+    need_bits(in, 15);
+    const struct huffman_entry *entry = lookup_entry(table, peek_bits(in));
+    *valid = entry->len != 0 || in->bit_cnt < 15;
+    if (entry->len == 0 || entry->len > in->bit_cnt)
+        return false;
+
+    consume_bits(in, entry->len);
+    *symbol = entry->symbol;
+    return true;
+}
+
+static enum ungzip_stream_status stream_error(struct ungzip_stream *s)
+{
+    s->state = STREAM_ERROR;
+    return UNGZIP_STREAM_ERROR;
+}
+
+// output from crc_pos on is added to the CRC32 and size of the member
+static void update_crc(struct ungzip_stream *s)
+{
+    size_t len = s->out_pos - s->crc_pos;
+    s->crc = crc32_update(s->crc, s->out_buf + s->crc_pos, len);
+    s->size += len;
+    s->crc_pos = s->out_pos;
+    return;
+}
+
+// once all output was read and the buffer is nearly full the last
+// 32768 bytes are moved to its front
+static void make_room(struct ungzip_stream *s)
+{
+    if (s->read_pos != s->out_pos ||
+        s->out_size - s->out_pos >= 258)
+        return;
+
+    update_crc(s);
+    size_t keep = MAX_DISTANCE;
+    size_t shift = s->out_pos - keep;
+    memmove(s->out_buf, s->out_buf + shift, keep);
+    s->out_pos = keep;
+    s->read_pos = keep;
+    s->crc_pos = keep;
+    s->member_start = s->member_start > shift ? s->member_start - shift : 0;
+    return;
+}
+
+static bool check_stream_header(struct ungzip_stream *s)
+{
+    if (s->bytes[0] != 0x1f || s->bytes[1] != 0x8b) {
+        log_error("Invalid ID1 or ID2 byte\n");
+        return false;
+    }
+
+    if (s->bytes[2] != 8) {
+        log_error("Unknown compression method\n");
+        return false;
+    }
+
+    s->FLG = s->bytes[3];
+    if (s->FLG & FRESERVED) {
+        log_error("Reserved bits should be set to zero\n");
+        return false;
+    }
+
+    return true;
+}
+
+static bool check_stream_trailer(struct ungzip_stream *s)
+{
+    const uint8_t *p = s->bytes;
+    uint32_t CRC_32 = p[0] + 256u * p[1] + 65536u * p[2] + 16777216u * p[3];
+    uint32_t ISIZE = p[4] + 256u * p[5] + 65536u * p[6] + 16777216u * p[7];
+
+    update_crc(s);
+    if (CRC_32 != s->crc) {
+        log_error("CRC32 doesn't match decompressed data\n");
+        return false;
+    }
+
+    if (ISIZE != (uint32_t) s->size) {
+        log_error("ISIZE doesn't match decompressed data size\n");
+        return false;
+    }
+
+    return true;
+}
+
+static void end_block(struct ungzip_stream *s)
+{
+    if (!s->final) {
+        s->state = STREAM_BLOCK_HEADER;
+        return;
+    }
+
+    // CRC32 and ISIZE start at the next byte boundary
+    align_to_byte(&s->in);
+    s->cnt = 0;
+    s->state = STREAM_TRAILER;
+    return;
+}
+
+// decodes whole literals and matches while there is input for full
+// word refills and room for the longest match, returns true at the end
+// of block code
+static bool decode_fast(struct ungzip_stream *s, bool *end_of_block)
+{
+    struct bit_reader in = s->in;
+    uint8_t *out = s->out_buf + s->out_pos;
+    uint8_t *out_end = s->out_buf + s->out_size - 258;
+    const uint8_t *window = s->out_buf + s->member_start;
+    bool success = true;
+
+    *end_of_block = false;
+    while (in.buf_len - in.buf_pos >= FAST_INPUT_MARGIN && out <= out_end) {
+        if (in.bit_cnt < 48)
+            refill_bits_fast(&in);
+
+        const struct huffman_entry *entry = lookup_entry(s->ll_table,
+                                                         peek_bits(&in));
+        if (entry->len == 0) {
+            log_error("Invalid huffman code for literal length\n");
+            success = false;
+            break;
+        }
+        consume_bits(&in, entry->len);
+        uint16_t code = entry->symbol;
+
+        if (is_literal_code(code)) {
+            *out++ = (uint8_t) code;
+            continue;
+        }
+
+        if (code == 256) {
+            *end_of_block = true;
+            break;
+        }
+
+        if (!is_length_code(code)) {
+            log_error("Invalid literal length code\n");
+            success = false;
+            break;
+        }
+
+        const struct value_and_bits *ld = &length_data[code - 257];
+        uint16_t extra_bits_value = (uint16_t) take_bits(&in, ld->extra_bits);
+        // 258 has separate length code 285
+        if (code == 284 && extra_bits_value == 31) {
+            log_error("Unexpected length extra value 31 for code 284\n");
+            success = false;
+            break;
+        }
+        uint16_t length = ld->value + extra_bits_value;
+
+        entry = lookup_entry(s->d_table, peek_bits(&in));
+        if (entry->len == 0 || !is_distance_code(entry->symbol)) {
+            log_error("Invalid huffman code for distance\n");
+            success = false;
+            break;
+        }
+        consume_bits(&in, entry->len);
+
+        const struct value_and_bits *dd = &dist_data[entry->symbol];
+        uint16_t distance = dd->value + (uint16_t) take_bits(&in, dd->extra_bits);
+        if (distance > out - window) {
+            log_error("Invalid back reference for copying bytes\n");
+            success = false;
+            break;
+        }
+
+        copy_match(out, distance, length);
+        out += length;
+    }
+
+    s->in = in;
+    s->out_pos = (size_t) (out - s->out_buf);
+    return success;
+}
+
+// runs the decoder until it needs more input or room for output
+static enum ungzip_stream_status inflate_stream(struct ungzip_stream *s)
+{
+    struct bit_reader *in = &s->in;
+    bool valid = true;
+
+    while (true) {
+        switch (s->state) {
+        case STREAM_HEADER:
+            if (s->cnt == 0 && in->bit_cnt == 0 && in->buf_pos == in->buf_len)
+                return s->members ? UNGZIP_STREAM_END :
+                    UNGZIP_STREAM_NEED_INPUT;
+            for (; s->cnt < 10; s->cnt++) {
+                if (!get_byte(in, &s->bytes[s->cnt]))
+                    return UNGZIP_STREAM_NEED_INPUT;
+            }
+            if (!check_stream_header(s))
+                return stream_error(s);
+            s->cnt = 0;
+            s->state = STREAM_EXTRA_LEN;
+            break;
+
+        case STREAM_EXTRA_LEN:
+            if (s->FLG & FEXTRA) {
+                if (!need_bits(in, 16))
+                    return UNGZIP_STREAM_NEED_INPUT;
+                s->len = (uint16_t) take_bits(in, 16);
+                s->cnt = 0;
+            }
+            s->state = STREAM_EXTRA;
+            break;
+
+        case STREAM_EXTRA:
+            if (s->FLG & FEXTRA) {
+                uint8_t byte = 0;
+                for (; s->cnt < s->len; s->cnt++) {
+                    if (!get_byte(in, &byte))
+                        return UNGZIP_STREAM_NEED_INPUT;
+                }
+            }
+            s->state = STREAM_NAME;
+            break;
+
+        case STREAM_NAME:
+        case STREAM_COMMENT: {
+            // zero-terminated original file name and file comment
+            uint8_t flag = s->state == STREAM_NAME ? FNAME : FCOMMENT;
+            uint8_t byte = 1;
+            while ((s->FLG & flag) && byte != 0) {
+                if (!get_byte(in, &byte))
+                    return UNGZIP_STREAM_NEED_INPUT;
+            }
+            s->state = s->state == STREAM_NAME ? STREAM_COMMENT : STREAM_HCRC;
+            break;
+        }
+
+        case STREAM_HCRC:
+            if (s->FLG & FHCRC) {
+                if (!need_bits(in, 16))
+                    return UNGZIP_STREAM_NEED_INPUT;
+                consume_bits(in, 16);
+            }
+            s->crc = 0;
+            s->size = 0;
+            s->member_start = s->out_pos;
+            s->state = STREAM_BLOCK_HEADER;
+            break;
+
+        case STREAM_BLOCK_HEADER: {
+            // BFINAL (1 bit), BTYPE (2 bits)
+            if (!need_bits(in, 3))
+                return UNGZIP_STREAM_NEED_INPUT;
+            uint8_t header = (uint8_t) take_bits(in, 3);
+            s->final = header & 1;
+            uint8_t BTYPE = header >> 1;
+            if (BTYPE == 0) {
+                align_to_byte(in);
+                s->state = STREAM_STORED_LEN;
+            } else if (BTYPE == 1) {
+                s->ll_table = &fixed_ll_table;
+                s->d_table = &fixed_d_table;
+                s->state = STREAM_LITLEN;
+            } else if (BTYPE == 2) {
+                s->state = STREAM_TABLE_COUNTS;
+            } else {
+                log_error("Error BTYPE\n");
+                return stream_error(s);
+            }
+            break;
+        }
+
+        case STREAM_STORED_LEN: {
+            if (!need_bits(in, 32))
+                return UNGZIP_STREAM_NEED_INPUT;
+            uint16_t LEN = (uint16_t) take_bits(in, 16);
+            uint16_t NLEN = (uint16_t) take_bits(in, 16);
+            if (LEN != (uint16_t) (~NLEN)) {
+                log_error("LEN doesn't match ~NLEN in block type 00\n");
+                return stream_error(s);
+            }
+            s->len = LEN;
+            s->state = STREAM_STORED;
+            break;
+        }
+
+        case STREAM_STORED:
+            // bytes already loaded in the bit buffer come first
+            while (s->len && in->bit_cnt >= 8) {
+                if (s->out_pos == s->out_size)
+                    return UNGZIP_STREAM_OK;
+                s->out_buf[s->out_pos++] = (uint8_t) take_bits(in, 8);
+                s->len--;
+            }
+            // the rest is copied from the input, nothing is left in the
+            // bit buffer that a later load could collide with
+            if (s->len)
+                in->bits = 0;
+            while (s->len) {
+                size_t space = s->out_size - s->out_pos;
+                size_t avail = in->buf_len - in->buf_pos;
+                if (space == 0)
+                    return UNGZIP_STREAM_OK;
+                if (avail == 0)
+                    return UNGZIP_STREAM_NEED_INPUT;
+                size_t n = s->len;
+                n = n < space ? n : space;
+                n = n < avail ? n : avail;
+                memcpy(s->out_buf + s->out_pos, in->buf + in->buf_pos, n);
+                s->out_pos += n;
+                in->buf_pos += n;
+                s->len -= (uint16_t) n;
+            }
+            end_block(s);
+            break;
+
+        case STREAM_TABLE_COUNTS:
+            // HLIT 5 bits, HDIST 5 bits, HCLEN 4 bits
+            // ref: https://www.rfc-editor.org/rfc/rfc1951.txt section 3.2.7
+            if (!need_bits(in, 14))
+                return UNGZIP_STREAM_NEED_INPUT;
+            s->ll_code_cnt = (uint16_t) take_bits(in, 5) + 257;
+            s->d_code_cnt = (uint8_t) take_bits(in, 5) + 1;
+            s->cl_code_cnt = (uint8_t) take_bits(in, 4) + 4;
+            if (s->ll_code_cnt > 286) {
+                log_error("Expecting ll code count to be between 257 to 285 "
+                          " in block type 10\n");
+                return stream_error(s);
+            }
+            memset(s->cl_code_lengths, 0, sizeof(s->cl_code_lengths));
+            s->cnt = 0;
+            s->state = STREAM_CL_LENGTHS;
+            break;
+
+        case STREAM_CL_LENGTHS: {
+            static const uint8_t cl_code_serial[19] = {
+                16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14,
+                1, 15};
+            for (; s->cnt < s->cl_code_cnt; s->cnt++) {
+                // cl code lengths are 3 bits each
+                if (!need_bits(in, 3))
+                    return UNGZIP_STREAM_NEED_INPUT;
+                s->cl_code_lengths[cl_code_serial[s->cnt]] =
+                    (uint8_t) take_bits(in, 3);
+            }
+
+            if (!create_huffman_table(s->cl_code_lengths, 19, 7,
+                                      CL_PRIMARY_BITS, s->cl_entries,
+                                      CL_TABLE_ENTRIES, &s->cl_table)) {
+                log_error("Failed to create code length huffman table for "
+                          "block type 10\n");
+                return stream_error(s);
+            }
+            s->len = s->ll_code_cnt + s->d_code_cnt;
+            s->cnt = 0;
+            s->state = STREAM_CODE_LENGTHS;
+            break;
+        }
+
+        case STREAM_CODE_LENGTHS:
+            // the literal/length and distance code lengths form a single
+            // sequence that repeat codes can cross
+            while (s->cnt < s->len) {
+                uint16_t symbol = 0;
+                if (!decode_stream_symbol(in, &s->cl_table, &symbol, &valid))
+                    break;
+                if (symbol <= 15) {
+                    s->code_lengths[s->cnt++] = (uint8_t) symbol;
+                    continue;
+                }
+                if (symbol == 16 && s->cnt == 0) {
+                    log_error("Repeat code 16 without any previous "
+                              "code length in block type 10\n");
+                    return stream_error(s);
+                }
+                s->symbol = symbol;
+                s->state = STREAM_CODE_REPEAT;
+                break;
+            }
+            if (!valid) {
+                log_error("Could not find huffman code in block type 10\n");
+                return stream_error(s);
+            }
+            if (s->state == STREAM_CODE_REPEAT)
+                break;
+            if (s->cnt < s->len)
+                return UNGZIP_STREAM_NEED_INPUT;
+
+            if (!create_huffman_table(s->code_lengths, s->ll_code_cnt, 15,
+                                      LL_PRIMARY_BITS, s->ll_entries,
+                                      LL_TABLE_ENTRIES,
+                                      &s->dynamic_ll_table)) {
+                log_error("Failed to create huffman table for ll codes in "
+                          "block type 10\n");
+                return stream_error(s);
+            }
+            if (!create_huffman_table(s->code_lengths + s->ll_code_cnt,
+                                      s->d_code_cnt, 15, D_PRIMARY_BITS,
+                                      s->d_entries, D_TABLE_ENTRIES,
+                                      &s->dynamic_d_table)) {
+                log_error("Failed to create huffman table for distance codes "
+                          "in block type 10\n");
+                return stream_error(s);
+            }
+            s->ll_table = &s->dynamic_ll_table;
+            s->d_table = &s->dynamic_d_table;
+            s->state = STREAM_LITLEN;
+            break;
+
+        case STREAM_CODE_REPEAT: {
+            // 16 repeats the previous length 3 - 6 times, 17 repeats zero
+            // 3 - 10 times and 18 repeats zero 11 - 138 times
+            uint8_t extra_bits = s->symbol == 16 ? 2 :
+                s->symbol == 17 ? 3 : 7;
+            uint8_t plus = s->symbol == 18 ? 11 : 3;
+            if (!need_bits(in, extra_bits))
+                return UNGZIP_STREAM_NEED_INPUT;
+            uint16_t repeat = (uint16_t) take_bits(in, extra_bits) + plus;
+            if (s->len - s->cnt < repeat) {
+                log_error("Repeat code exceeds HLIT + HDIST + 258 "
+                          "values in block type 10\n");
+                return stream_error(s);
+            }
+            uint8_t length = s->symbol == 16 ? s->code_lengths[s->cnt - 1] : 0;
+            memset(s->code_lengths + s->cnt, length, repeat);
+            s->cnt += repeat;
+            s->state = STREAM_CODE_LENGTHS;
+            break;
+        }
+
+        case STREAM_LITLEN: {
+            bool end_of_block = false;
+            if (!decode_fast(s, &end_of_block))
+                return stream_error(s);
+            if (end_of_block) {
+                end_block(s);
+                break;
+            }
+
+            // one symbol at a time near the end of input or output
+            if (s->out_pos == s->out_size)
+                return UNGZIP_STREAM_OK;
+            uint16_t code = 0;
+            if (!decode_stream_symbol(in, s->ll_table, &code, &valid)) {
+                if (!valid) {
+                    log_error("Could not find huffman code for literal "
+                              "length\n");
+                    return stream_error(s);
+                }
+                return UNGZIP_STREAM_NEED_INPUT;
+            }
+            if (is_literal_code(code)) {
+                s->out_buf[s->out_pos++] = (uint8_t) code;
+            } else if (code == 256) {
+                end_block(s);
+            } else if (is_length_code(code)) {
+                s->symbol = code;
+                s->state = STREAM_LENGTH_EXTRA;
+            } else {
+                log_error("Invalid literal length code\n");
+                return stream_error(s);
+            }
+            break;
+        }
+
+        case STREAM_LENGTH_EXTRA: {
+            const struct value_and_bits *ld = &length_data[s->symbol - 257];
+            if (!need_bits(in, ld->extra_bits))
+                return UNGZIP_STREAM_NEED_INPUT;
+            uint16_t extra = (uint16_t) take_bits(in, ld->extra_bits);
+            // 258 has separate length code 285
+            if (s->symbol == 284 && extra == 31) {
+                log_error("Unexpected length extra value 31 for code 284\n");
+                return stream_error(s);
+            }
+            s->length = ld->value + extra;
+            s->state = STREAM_DISTANCE;
+            break;
+        }
+
+        case STREAM_DISTANCE:
+            if (!decode_stream_symbol(in, s->d_table, &s->symbol, &valid)) {
+                if (!valid) {
+                    log_error("Could not find huffman code for distance\n");
+                    return stream_error(s);
+                }
+                return UNGZIP_STREAM_NEED_INPUT;
+            }
+            if (!is_distance_code(s->symbol)) {
+                log_error("Expecting valid distance code\n");
+                return stream_error(s);
+            }
+            s->state = STREAM_DISTANCE_EXTRA;
+            break;
+
+        case STREAM_DISTANCE_EXTRA: {
+            const struct value_and_bits *dd = &dist_data[s->symbol];
+            if (!need_bits(in, dd->extra_bits))
+                return UNGZIP_STREAM_NEED_INPUT;
+            s->distance = dd->value + (uint16_t) take_bits(in, dd->extra_bits);
+            if (s->distance > s->out_pos - s->member_start) {
+                log_error("Invalid back reference for copying bytes\n");
+                return stream_error(s);
+            }
+            s->state = STREAM_COPY;
+            break;
+        }
+
+        case STREAM_COPY: {
+            // the match continues after the output was read
+            uint8_t *out = s->out_buf + s->out_pos;
+            size_t space = s->out_size - s->out_pos;
+            uint16_t n = s->length < space ? s->length : (uint16_t) space;
+            for (uint16_t i = 0; i < n; ++i)
+                out[i] = out[i - s->distance];
+            s->out_pos += n;
+            s->length -= n;
+            if (s->length)
+                return UNGZIP_STREAM_OK;
+            s->state = STREAM_LITLEN;
+            break;
+        }
+
+        case STREAM_TRAILER:
+            for (; s->cnt < 8; s->cnt++) {
+                if (!get_byte(in, &s->bytes[s->cnt]))
+                    return UNGZIP_STREAM_NEED_INPUT;
+            }
+            if (!check_stream_trailer(s))
+                return stream_error(s);
+            s->members++;
+            s->cnt = 0;
+            s->state = STREAM_HEADER;
+            break;
+
+        case STREAM_ERROR:
+            return UNGZIP_STREAM_ERROR;
+        }
+    }
+}
+
+// hands out as much of the output that wasn't read yet as fits
+static void read_output(struct ungzip_stream *s, uint8_t *out,
+                        size_t out_len, size_t *written)
+{
+    size_t n = s->out_pos - s->read_pos;
+    if (n > out_len - *written)
+        n = out_len - *written;
+    if (n) {
+        memcpy(out + *written, s->out_buf + s->read_pos, n);
+        s->read_pos += n;
+        *written += n;
+    }
+    return;
+}
+
+enum ungzip_stream_status ungzip_stream_read(struct ungzip_stream *s,
+                                             uint8_t *out, size_t out_len,
+                                             size_t *written)
+{
+    *written = 0;
+    while (true) {
+        read_output(s, out, out_len, written);
+        if (*written == out_len)
+            return UNGZIP_STREAM_OK;
+
+        make_room(s);
+        enum ungzip_stream_status status = inflate_stream(s);
+        if (status != UNGZIP_STREAM_OK) {
+            read_output(s, out, out_len, written);
+            return s->read_pos == s->out_pos ? status : UNGZIP_STREAM_OK;
+        }
+    }
+}
+
+enum ungzip_stream_status ungzip_stream_write(struct ungzip_stream *s,
+                                              struct sink *sink)
+{
+    enum ungzip_stream_status status = UNGZIP_STREAM_OK;
+    while (true) {
+        if (!write_sink(sink, s->out_buf + s->read_pos,
+                        s->out_pos - s->read_pos))
+            return stream_error(s);
+        s->read_pos = s->out_pos;
+        if (status != UNGZIP_STREAM_OK)
+            return status;
+
+        make_room(s);
+        status = inflate_stream(s);
+    }
+}
@@ -0,0 +1,123 @@
+#ifndef UNGZIP_STREAM
+#define UNGZIP_STREAM
+
+#include "bit_reader.h"
+#include "deflate.h"
+#include "huffman_table.h"
+#include "sink.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// decompresses gzip data which is fed to it in pieces of any size, for
+// callers like event loops which can't block waiting for input. All of
+// the decoding state is kept in struct ungzip_stream, so decoding stops
+// wherever the input or the room for output runs out, in a member header,
+// in the code lengths of a dynamic block or in the middle of a match, and
+// goes on from there on the next call. Output is read with
+// ungzip_stream_read until it asks for more input, which is then fed with
+// ungzip_stream_feed
+
+// output decoded ahead of ungzip_stream_read, or handed to the sink by
+// ungzip_stream_write at a time
+#define UNGZIP_STREAM_READ_SIZE 65536
+#define UNGZIP_STREAM_MIN_READ_SIZE 4096
+
+enum ungzip_stream_status {
+    UNGZIP_STREAM_OK,         // out is full, there may be more output
+    UNGZIP_STREAM_NEED_INPUT, // all of the input fed was used
+    UNGZIP_STREAM_END,        // all of the input fed was used and ended
+                              // with a member trailer
+    UNGZIP_STREAM_ERROR       // invalid data, the stream can't go on
+};
+
+enum ungzip_stream_state {
+    STREAM_HEADER,
+    STREAM_EXTRA_LEN,
+    STREAM_EXTRA,
+    STREAM_NAME,
+    STREAM_COMMENT,
+    STREAM_HCRC,
+    STREAM_BLOCK_HEADER,
+    STREAM_STORED_LEN,
+    STREAM_STORED,
+    STREAM_TABLE_COUNTS,
+    STREAM_CL_LENGTHS,
+    STREAM_CODE_LENGTHS,
+    STREAM_CODE_REPEAT,
+    STREAM_LITLEN,
+    STREAM_LENGTH_EXTRA,
+    STREAM_DISTANCE,
+    STREAM_DISTANCE_EXTRA,
+    STREAM_COPY,
+    STREAM_TRAILER,
+    STREAM_ERROR
+};
+
+struct ungzip_stream {
+    enum ungzip_stream_state state;
+    struct bit_reader in;     // input fed last, the bits loaded from it
+                              // are kept when more input is fed
+    uint8_t bytes[10];        // member header or trailer read so far
+    uint8_t FLG;
+    uint16_t cnt;             // bytes or code lengths read in this state
+    uint16_t len;             // XLEN, LEN of stored block or code count
+    bool final;               // BFINAL of the current block
+    uint64_t members;         // members decompressed
+
+    // code lengths of the current dynamic block
+    uint16_t ll_code_cnt;
+    uint8_t d_code_cnt;
+    uint8_t cl_code_cnt;
+    uint8_t cl_code_lengths[19];
+    uint8_t code_lengths[286 + 32];
+    struct huffman_table cl_table;
+    struct huffman_table dynamic_ll_table;
+    struct huffman_table dynamic_d_table;
+    struct huffman_entry cl_entries[CL_TABLE_ENTRIES];
+    struct huffman_entry ll_entries[LL_TABLE_ENTRIES];
+    struct huffman_entry d_entries[D_TABLE_ENTRIES];
+    const struct huffman_table *ll_table; // tables of the current block
+    const struct huffman_table *d_table;
+
+    uint16_t symbol;          // length, distance or repeat code being read
+    uint16_t length;          // match length left to copy
+    uint16_t distance;
+
+    // decompressed output, the 32768 bytes before the output that wasn't
+    // read yet are kept for back references
+    uint8_t *out_buf;
+    size_t out_size;          // window and read size bytes of out_buf
+    size_t out_pos;           // next position in out_buf
+    size_t read_pos;          // start of output that wasn't read yet
+    size_t crc_pos;           // start of output not in crc and size yet
+    size_t member_start;      // out_buf position where the member started,
+                              // back references can't reach before it
+    uint32_t crc;             // CRC32 of the output of the member
+    uint64_t size;            // size of the output of the member
+};
+
+bool ungzip_stream_init(struct ungzip_stream *s);
+bool ungzip_stream_init_size(struct ungzip_stream *s, size_t read_size);
+
+// buf needs to stay valid until ungzip_stream_read returns
+// UNGZIP_STREAM_NEED_INPUT or UNGZIP_STREAM_END, feeding more before
+// fails
+bool ungzip_stream_feed(struct ungzip_stream *s, const uint8_t *buf,
+                        size_t len);
+
+// decompresses into out and sets *written to the bytes put there
+enum ungzip_stream_status ungzip_stream_read(struct ungzip_stream *s,
+                                             uint8_t *out, size_t out_len,
+                                             size_t *written);
+
+// decompresses like ungzip_stream_read until more input is needed, but
+// hands the output to sink straight from the stream's own buffer instead
+// of copying it into out. Returns UNGZIP_STREAM_ERROR if sink fails
+enum ungzip_stream_status ungzip_stream_write(struct ungzip_stream *s,
+                                              struct sink *sink);
+
+void ungzip_stream_end(struct ungzip_stream *s);
+
+#endif
@@ -0,0 +1,355 @@
+#include "uring.h"
+#include "sink.h"
+#include "log.h"
+
+#include <string.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <malloc.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+static int io_uring_setup(unsigned entries, struct io_uring_params *params)
+{
+    return (int) syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete,
+                          unsigned flags)
+{
+    return (int) syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+                         flags, NULL, 0);
+}
+
+static int io_uring_register(int fd, unsigned opcode, const void *arg,
+                             unsigned nr_args)
+{
+    return (int) syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+bool uring_init(struct uring *ring, unsigned entries)
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    ring->fd = io_uring_setup(entries, &params);
+    if (ring->fd == -1)
+        return false;
+
+    ring->sq_ring_len = params.sq_off.array +
+        params.sq_entries * sizeof(unsigned);
+    ring->cq_ring_len = params.cq_off.cqes +
+        params.cq_entries * sizeof(struct io_uring_cqe);
+    bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap && ring->cq_ring_len > ring->sq_ring_len)
+        ring->sq_ring_len = ring->cq_ring_len;
+    ring->sqes_len = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    ring->sq_ring = mmap(NULL, ring->sq_ring_len, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, ring->fd,
+                         IORING_OFF_SQ_RING);
+    ring->cq_ring = single_mmap ? ring->sq_ring :
+        mmap(NULL, ring->cq_ring_len, PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+    ring->sqes = mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sq_ring == MAP_FAILED || ring->cq_ring == MAP_FAILED ||
+        ring->sqes == MAP_FAILED) {
+        if (ring->sqes != MAP_FAILED)
+            munmap(ring->sqes, ring->sqes_len);
+        if (ring->cq_ring != MAP_FAILED && ring->cq_ring != ring->sq_ring)
+            munmap(ring->cq_ring, ring->cq_ring_len);
+        if (ring->sq_ring != MAP_FAILED)
+            munmap(ring->sq_ring, ring->sq_ring_len);
+        close(ring->fd);
+        return false;
+    }
+    if (single_mmap)
+        ring->cq_ring_len = 0;
+
+    uint8_t *sq = ring->sq_ring;
+    ring->sq_head = (unsigned *) (sq + params.sq_off.head);
+    ring->sq_tail = (unsigned *) (sq + params.sq_off.tail);
+    ring->sq_mask = *(unsigned *) (sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *) (sq + params.sq_off.array);
+
+    uint8_t *cq = ring->cq_ring;
+    ring->cq_head = (unsigned *) (cq + params.cq_off.head);
+    ring->cq_tail = (unsigned *) (cq + params.cq_off.tail);
+    ring->cq_mask = *(unsigned *) (cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *) (cq + params.cq_off.cqes);
+
+    ring->queued = 0;
+    return true;
+}
+
+void uring_exit(struct uring *ring)
+{
+    munmap(ring->sqes, ring->sqes_len);
+    if (ring->cq_ring != ring->sq_ring)
+        munmap(ring->cq_ring, ring->cq_ring_len);
+    munmap(ring->sq_ring, ring->sq_ring_len);
+    close(ring->fd);
+    return;
+}
+
+bool uring_register_buffers(struct uring *ring, const struct iovec *iov,
+                            unsigned cnt)
+{
+    return io_uring_register(ring->fd, IORING_REGISTER_BUFFERS, iov,
+                             cnt) == 0;
+}
+
+struct io_uring_sqe *uring_get_sqe(struct uring *ring)
+{
+    unsigned head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    unsigned tail = *ring->sq_tail + ring->queued;
+    if (tail - head > ring->sq_mask)
+        return NULL;
+
+    unsigned i = tail & ring->sq_mask;
+    ring->sq_array[i] = i;
+    ring->queued++;
+    return &ring->sqes[i];
+}
+
+void uring_prep_rw(struct io_uring_sqe *sqe, uint8_t opcode, int fd,
+                   const void *buf, uint32_t len, uint64_t offset,
+                   uint64_t user_data)
+{
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t) (uintptr_t) buf;
+    sqe->len = len;
+    sqe->off = offset;
+    sqe->user_data = user_data;
+    return;
+}
+
+bool uring_submit(struct uring *ring)
+{
+    // the kernel sees the sqes once the tail is stored
+    __atomic_store_n(ring->sq_tail, *ring->sq_tail + ring->queued,
+                     __ATOMIC_RELEASE);
+    while (ring->queued > 0) {
+        int cnt = io_uring_enter(ring->fd, ring->queued, 0, 0);
+        if (cnt == -1 && errno == EINTR)
+            continue;
+        if (cnt <= 0)
+            return false;
+        ring->queued -= (unsigned) cnt;
+    }
+
+    return true;
+}
+
+bool uring_wait(struct uring *ring, struct io_uring_cqe *cqe)
+{
+    while (true) {
+        unsigned head = *ring->cq_head;
+        if (head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+            *cqe = ring->cqes[head & ring->cq_mask];
+            __atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+            return true;
+        }
+
+        if (io_uring_enter(ring->fd, 0, 1, IORING_ENTER_GETEVENTS) == -1 &&
+            errno != EINTR)
+            return false;
+    }
+}
+
+// a buffer of output being filled or written
+struct uring_write {
+    size_t len;      // bytes of output in the buffer
+    size_t done;     // bytes of it written so far
+    uint64_t offset; // file offset of the buffer in regular files
+    bool busy;       // being written
+};
+
+struct uring_output {
+    struct uring ring;
+    int fd;
+    bool seekable;   // regular file written at offsets
+    bool fixed;      // buffers are registered with the ring
+    uint64_t offset; // file offset of the next buffer
+    uint8_t *bufs;   // URING_OUTPUT_BUFFERS buffers of buf_size bytes
+    size_t buf_size;
+    struct uring_write writes[URING_OUTPUT_BUFFERS];
+    unsigned current; // buffer being filled
+    unsigned in_flight;
+};
+
+static bool queue_write(struct uring_output *out, unsigned i)
+{
+    struct uring_write *w = &out->writes[i];
+    struct io_uring_sqe *sqe = uring_get_sqe(&out->ring);
+    if (sqe == NULL)
+        return false;
+
+    uint8_t opcode = out->fixed ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+    uint64_t offset = out->seekable ? w->offset + w->done : (uint64_t) -1;
+    uring_prep_rw(sqe, opcode, out->fd, out->bufs + i * out->buf_size +
+                  w->done, (uint32_t) (w->len - w->done), offset, i);
+    if (out->fixed)
+        sqe->buf_index = (uint16_t) i;
+    return uring_submit(&out->ring);
+}
+
+// short writes are written again from where they stopped
+static bool wait_write(struct uring_output *out)
+{
+    struct io_uring_cqe cqe;
+    if (!uring_wait(&out->ring, &cqe)) {
+        // nothing in flight can be waited for anymore
+        out->in_flight = 0;
+        return false;
+    }
+
+    unsigned i = (unsigned) cqe.user_data;
+    struct uring_write *w = &out->writes[i];
+    bool success = cqe.res > 0 || cqe.res == -EINTR || cqe.res == -EAGAIN;
+    if (cqe.res > 0)
+        w->done += (size_t) cqe.res;
+    if (success && w->done < w->len) {
+        if (queue_write(out, i))
+            return true;
+        success = false;
+    }
+
+    w->busy = false;
+    w->len = 0;
+    out->in_flight--;
+    return success;
+}
+
+static bool submit_current(struct uring_output *out)
+{
+    // the buffer after the last one submitted may still be in flight
+    struct uring_write *w = &out->writes[out->current];
+    if (w->len == 0 || w->busy)
+        return true;
+
+    // other files only have one write in flight so that they are in order
+    while (!out->seekable && out->in_flight > 0) {
+        if (!wait_write(out))
+            return false;
+    }
+
+    w->offset = out->offset;
+    w->done = 0;
+    w->busy = true;
+    out->offset += w->len;
+    out->in_flight++;
+    out->current = (out->current + 1) % URING_OUTPUT_BUFFERS;
+    return queue_write(out, (unsigned) (w - out->writes));
+}
+
+static bool write_uring(void *arg, const uint8_t *buf, size_t len)
+{
+    struct uring_output *out = arg;
+    while (len > 0) {
+        struct uring_write *w = &out->writes[out->current];
+        if (w->busy) {
+            if (!wait_write(out)) {
+                log_error("Could not write full buffer\n");
+                return false;
+            }
+            continue;
+        }
+
+        size_t n = out->buf_size - w->len;
+        if (n > len)
+            n = len;
+        memcpy(out->bufs + out->current * out->buf_size + w->len, buf, n);
+        w->len += n;
+        buf += n;
+        len -= n;
+        if (w->len == out->buf_size && !submit_current(out)) {
+            log_error("Could not write full buffer\n");
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void free_uring_output(struct uring_output *out)
+{
+    uring_exit(&out->ring);
+    munmap(out->bufs, URING_OUTPUT_BUFFERS * out->buf_size);
+    free(out);
+    return;
+}
+
+// the file offset of regular files is left after the output like plain
+// writes would
+static bool finish_uring(void *arg)
+{
+    struct uring_output *out = arg;
+    bool success = submit_current(out);
+
+    // buffers are only released once the kernel is done with them
+    while (out->in_flight > 0) {
+        if (!wait_write(out))
+            success = false;
+    }
+    if (success && out->seekable &&
+        lseek(out->fd, (off_t) out->offset, SEEK_SET) == -1)
+        success = false;
+    if (!success)
+        log_error("Could not write full buffer\n");
+
+    free_uring_output(out);
+    return success;
+}
+
+bool init_uring_sink(struct sink *sink, int fd, size_t write_size)
+{
+    struct uring_output *out = malloc(sizeof(struct uring_output));
+    if (out == NULL)
+        return false;
+
+    // the ring has room for a write of every buffer
+    if (write_size > UINT32_MAX || !uring_init(&out->ring, 8)) {
+        free(out);
+        return false;
+    }
+
+    out->buf_size = write_size;
+    out->bufs = mmap(NULL, URING_OUTPUT_BUFFERS * write_size,
+                     PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                     -1, 0);
+    if (out->bufs == MAP_FAILED) {
+        uring_exit(&out->ring);
+        free(out);
+        return false;
+    }
+
+    struct stat st;
+    off_t offset = lseek(fd, 0, SEEK_CUR);
+    out->seekable = fstat(fd, &st) == 0 && S_ISREG(st.st_mode) &&
+        offset != -1;
+    out->offset = out->seekable ? (uint64_t) offset : 0;
+    out->fd = fd;
+    out->current = 0;
+    out->in_flight = 0;
+    memset(out->writes, 0, sizeof(out->writes));
+
+    // registering pins the buffers, which may be over the memlock limit
+    struct iovec iov[URING_OUTPUT_BUFFERS];
+    for (unsigned i = 0; i < URING_OUTPUT_BUFFERS; ++i) {
+        iov[i].iov_base = out->bufs + i * write_size;
+        iov[i].iov_len = write_size;
+    }
+    out->fixed = uring_register_buffers(&out->ring, iov,
+                                        URING_OUTPUT_BUFFERS);
+
+    init_callback_sink(sink, write_uring, out);
+    sink->finish = finish_uring;
+    sink->fd = fd;
+    return true;
+}
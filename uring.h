@@ -0,0 +1,64 @@
+#ifndef URING
+#define URING
+
+#include "sink.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+// a minimal io_uring on the raw system calls. Kernels or sandboxes
+// without it make uring_init fail, callers then use plain system calls
+// ref: https://kernel.dk/io_uring.pdf
+struct uring {
+    int fd;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned sq_mask;
+    unsigned *sq_array;
+    struct io_uring_sqe *sqes;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe *cqes;
+    void *sq_ring;       // mappings of the rings shared with the kernel,
+    size_t sq_ring_len;  // the completion ring is in the same mapping as
+    void *cq_ring;       // the submission ring on most kernels
+    size_t cq_ring_len;
+    size_t sqes_len;
+    unsigned queued;     // sqes not submitted yet
+};
+
+bool uring_init(struct uring *ring, unsigned entries);
+void uring_exit(struct uring *ring);
+
+// buffers registered as buf_index 0 to cnt - 1 for the fixed operations
+bool uring_register_buffers(struct uring *ring, const struct iovec *iov,
+                            unsigned cnt);
+
+// NULL if the submission queue is full
+struct io_uring_sqe *uring_get_sqe(struct uring *ring);
+void uring_prep_rw(struct io_uring_sqe *sqe, uint8_t opcode, int fd,
+                   const void *buf, uint32_t len, uint64_t offset,
+                   uint64_t user_data);
+
+// hands the queued sqes to the kernel
+bool uring_submit(struct uring *ring);
+
+// waits for the next completion and copies it to cqe
+bool uring_wait(struct uring *ring, struct io_uring_cqe *cqe);
+
+// output buffers kept in flight by an io_uring sink, each of them
+// write_size bytes
+#define URING_OUTPUT_BUFFERS 4
+
+// writes to fd through io_uring from URING_OUTPUT_BUFFERS buffers the
+// output is copied into, so that decoding goes on while they are being
+// written. Regular files get all of them in flight at their offsets,
+// other files one at a time to keep the output in order. Returns false
+// if io_uring isn't available
+bool init_uring_sink(struct sink *sink, int fd, size_t write_size);
+
+#endif